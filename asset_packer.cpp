@@ -0,0 +1,190 @@
+// Asset Packer - offline tool, run from the data directory to turn the bmps into test.hha
+#include "handmade_platform.h"
+#include "handmade_math.h"
+#include "handmade_intrinsics.h"
+#include "handmade_file_formats.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#pragma pack(push, 1)
+struct BitmapHeader {
+    u16 file_type;
+    u32 file_size;
+    u16 reserved_1;
+    u16 reserved_2;
+    u32 bitmap_offset;
+    u32 size;
+    s32 width;
+    s32 height;
+    u16 planes;
+    u16 bits_per_pixel;
+    u32 compression;
+    u32 size_of_bitmap;
+    s32 horz_resolution;
+    s32 vert_resolution;
+    u32 colors_used;
+    u32 colors_important;
+
+    u32 red_mask;
+    u32 green_mask;
+    u32 blue_mask;
+};
+#pragma pack(pop)
+
+struct SourceBitmap {
+    AssetBitmapId id;
+    char* filename;
+    s32 align_x;
+    s32 align_y;
+};
+
+struct PackedBitmap {
+    s32 width;
+    s32 height;
+    u32* pixels;
+};
+
+global SourceBitmap source_bitmaps[] = {
+    {ABI_BACKDROP, "test/test_background.bmp", 0, 0},
+    // the shadow sits under the hero, so it shares the hero alignment
+    {ABI_SHADOW, "test/test_hero_shadow.bmp", 72, 182},
+    {ABI_TREE, "test2/tree00.bmp", 40, 80},
+
+    {ABI_HERO_HEAD_RIGHT, "test/test_hero_right_head.bmp", 72, 182},
+    {ABI_HERO_HEAD_BACK, "test/test_hero_back_head.bmp", 72, 182},
+    {ABI_HERO_HEAD_LEFT, "test/test_hero_left_head.bmp", 72, 182},
+    {ABI_HERO_HEAD_FRONT, "test/test_hero_front_head.bmp", 72, 182},
+
+    {ABI_HERO_CAPE_RIGHT, "test/test_hero_right_cape.bmp", 72, 182},
+    {ABI_HERO_CAPE_BACK, "test/test_hero_back_cape.bmp", 72, 182},
+    {ABI_HERO_CAPE_LEFT, "test/test_hero_left_cape.bmp", 72, 182},
+    {ABI_HERO_CAPE_FRONT, "test/test_hero_front_cape.bmp", 72, 182},
+
+    {ABI_HERO_TORSO_RIGHT, "test/test_hero_right_torso.bmp", 72, 182},
+    {ABI_HERO_TORSO_BACK, "test/test_hero_back_torso.bmp", 72, 182},
+    {ABI_HERO_TORSO_LEFT, "test/test_hero_left_torso.bmp", 72, 182},
+    {ABI_HERO_TORSO_FRONT, "test/test_hero_front_torso.bmp", 72, 182},
+};
+
+internal void* read_entire_file(char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", filename);
+        exit(1);
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    void* result = malloc(size);
+    if (fread(result, 1, size, file) != (size_t)size) {
+        fprintf(stderr, "could not read %s\n", filename);
+        exit(1);
+    }
+    fclose(file);
+
+    return result;
+}
+
+// converts to top down premultiplied 0xAARRGGBB, which is what the game blits
+internal PackedBitmap load_bmp(char* filename) {
+    u8* contents = (u8*)read_entire_file(filename);
+    BitmapHeader* header = (BitmapHeader*)contents;
+    u32* source = (u32*)(contents + header->bitmap_offset);
+
+    if (header->compression != 3 || header->bits_per_pixel != 32) {
+        fprintf(stderr, "%s: only 32 bit BI_BITFIELDS bitmaps are supported\n", filename);
+        exit(1);
+    }
+
+    u32 alpha_mask = ~(header->red_mask | header->green_mask | header->blue_mask);
+
+    u32 red_shift = find_least_significant_set_bit(header->red_mask);
+    u32 green_shift = find_least_significant_set_bit(header->green_mask);
+    u32 blue_shift = find_least_significant_set_bit(header->blue_mask);
+    u32 alpha_shift = find_least_significant_set_bit(alpha_mask);
+
+    // positive height means the bmp goes from bottom to top
+    bool bottom_up = header->height > 0;
+    PackedBitmap result = {};
+    result.width = header->width;
+    result.height = bottom_up ? header->height : -header->height;
+    result.pixels = (u32*)malloc(result.width * result.height * sizeof(u32));
+
+    for (s32 y = 0; y < result.height; ++y) {
+        u32* source_row = source + (bottom_up ? (result.height - 1 - y) : y) * result.width;
+        u32* dest_row = result.pixels + y * result.width;
+        for (s32 x = 0; x < result.width; ++x) {
+            u32 c = source_row[x];
+            u32 a = (c >> alpha_shift) & 0xFF;
+            u32 r = (((c >> red_shift) & 0xFF) * a + 127) / 255;
+            u32 g = (((c >> green_shift) & 0xFF) * a + 127) / 255;
+            u32 b = (((c >> blue_shift) & 0xFF) * a + 127) / 255;
+            dest_row[x] = (a << 24) | (r << 16) | (g << 8) | (b << 0);
+        }
+    }
+
+    free(contents);
+    return result;
+}
+
+internal u64 align_offset(u64 offset, u64 alignment) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+int main(int argc, char** argv) {
+    char* out_filename = argc > 1 ? argv[1] : (char*)"test.hha";
+
+    if (array_count(source_bitmaps) != ABI_COUNT) {
+        fprintf(stderr, "every AssetBitmapId needs a source bitmap\n");
+        return 1;
+    }
+
+    HHABitmap bitmaps[ABI_COUNT] = {};
+    PackedBitmap packed[ABI_COUNT] = {};
+
+    HHAHeader header = {};
+    header.magic_value = HHA_MAGIC_VALUE;
+    header.version = HHA_VERSION;
+    header.bitmap_count = ABI_COUNT;
+    header.bitmaps = sizeof(header);
+
+    u64 offset = header.bitmaps + sizeof(bitmaps);
+    for (u32 i = 0; i < array_count(source_bitmaps); ++i) {
+        SourceBitmap* source = source_bitmaps + i;
+        PackedBitmap bitmap = load_bmp(source->filename);
+        packed[source->id] = bitmap;
+
+        HHABitmap* dest = bitmaps + source->id;
+        dest->width = bitmap.width;
+        dest->height = bitmap.height;
+        dest->align_x = source->align_x;
+        dest->align_y = source->align_y;
+
+        offset = align_offset(offset, HHA_PIXEL_ALIGNMENT);
+        dest->pixels = offset;
+        offset += (u64)bitmap.width * bitmap.height * sizeof(u32);
+    }
+
+    FILE* out = fopen(out_filename, "wb");
+    if (!out) {
+        fprintf(stderr, "could not open %s for writing\n", out_filename);
+        return 1;
+    }
+
+    fwrite(&header, sizeof(header), 1, out);
+    fwrite(bitmaps, sizeof(bitmaps), 1, out);
+    for (u32 i = 0; i < ABI_COUNT; ++i) {
+        u8 zero[HHA_PIXEL_ALIGNMENT] = {};
+        u64 padding = bitmaps[i].pixels - (u64)ftell(out);
+        fwrite(zero, 1, padding, out);
+        fwrite(packed[i].pixels, sizeof(u32), packed[i].width * packed[i].height, out);
+    }
+    fclose(out);
+
+    printf("wrote %u bitmaps, %llu bytes to %s\n", ABI_COUNT, (unsigned long long)offset, out_filename);
+    return 0;
+}
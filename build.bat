@@ -19,10 +19,25 @@ REM 64-bit-windows-11 build
 
 del *pdb > NUL 2> NUL
 del *dll > NUL 2> NUL
-set game_linker_flags=-EXPORT:game_update_and_render -EXPORT:game_get_sound_samples -PDB:"handmade_%random%.pdb"
+set game_linker_flags=-EXPORT:game_update_and_render -EXPORT:game_get_sound_samples -EXPORT:debug_game_get_memory_stats -PDB:"handmade_%random%.pdb"
 cl %warning_flags% %env_variables% %compiler_flags% -Fmhandmade.map -LD ..\handmade.cpp -link %linker_flags% %game_linker_flags%
 
 set win32_linker_flags=user32.lib Gdi32.lib winmm.lib
 cl %warning_flags% %env_variables% %compiler_flags% -Fmwin32_handmade.map ..\win32_handmade.cpp -link %linker_flags% %win32_linker_flags%
 
+REM offline tool, the game maps the test.hha it writes
+cl %warning_flags% %env_variables% %compiler_flags% -D_CRT_SECURE_NO_WARNINGS ..\asset_packer.cpp -link %linker_flags%
+
+REM timings for the per frame entity passes, no HANDMADE_SLOW so validation stays out of them
+cl %warning_flags% -DHANDMADE_INTERNAL=1 -DHANDMADE_SLOW=0 -DHANDMADE_WIN32=1 %compiler_flags% -D_CRT_SECURE_NO_WARNINGS ..\entity_benchmark.cpp -link %linker_flags%
+
+REM checks against the reference paths, run below, HANDMADE_SLOW so the game's asserts are live too
+cl %warning_flags% %env_variables% %compiler_flags% -D_CRT_SECURE_NO_WARNINGS ..\handmade_tests.cpp -link %linker_flags%
+
+pushd ..\data
+..\build\asset_packer.exe test.hha
+popd
+
+handmade_tests.exe
+
 popd
@@ -0,0 +1,161 @@
+// Entity Benchmark - offline tool, runs the per frame entity passes over a dense sim region
+// without a platform layer. Build it without HANDMADE_SLOW so the validation sweeps stay out
+// of the timings.
+#include "handmade.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if COMPILER_MSVC
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+
+// the HighEntity layout before it was split into arrays, kept here to measure against
+struct InterleavedHighEntity {
+    V2 p;
+    V2 dp;
+    u32 facing_direction;
+    u32 chunk_z;
+
+    f32 z;
+    f32 dz;
+
+    u32 low_entity_index;
+};
+
+internal void integrate_interleaved(InterleavedHighEntity* entities, u32 count, V2 offset, f32 dt) {
+    f32 ddz = -9.8f;
+    for (u32 i = 1; i < count; ++i) {
+        InterleavedHighEntity* high_entity = entities + i;
+        high_entity->p += offset;
+        high_entity->z = (0.5f * ddz * square(dt)) + (high_entity->dz * dt) + high_entity->z;
+        high_entity->dz = (ddz * dt) + high_entity->dz;
+        if (high_entity->z < 0) {
+            high_entity->z = 0;
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    u32 entity_count = argc > 1 ? atoi(argv[1]) : 12000;
+    u32 mover_count = argc > 2 ? atoi(argv[2]) : 1000;
+    u32 frame_count = 200;
+    f32 dt = 1.0f / 60.0f;
+
+    if (entity_count + 1 > MAX_HIGH_ENTITY_COUNT || mover_count > entity_count) {
+        fprintf(stderr, "usage: entity_benchmark [entities < %u] [movers <= entities]\n", MAX_HIGH_ENTITY_COUNT);
+        return 1;
+    }
+
+    GameState* game_state = (GameState*)calloc(1, sizeof(GameState));
+    if (!game_state || ((size_t)game_state & 15)) {
+        fprintf(stderr, "could not allocate an aligned GameState\n");
+        return 1;
+    }
+
+    size_t world_arena_size = megabytes(64);
+    initialize_arena(&game_state->world_arena, world_arena_size, (u8*)calloc(1, world_arena_size));
+    game_state->world = push_struct(&game_state->world_arena, World);
+    World* world = game_state->world;
+    initialize_world(world, &game_state->world_arena, 1.4f);
+    initialize_entity_templates(game_state);
+
+    add_low_entity(game_state, ET_NULL, NULL);
+    game_state->high_entity_count = 1;
+
+    WorldPosition camera_p = centered_chunk_point(100, 100, 0);
+    game_state->camera_p = camera_p;
+    set_camera(game_state, camera_p);
+    SimChunkRegion region = game_state->sim_region;
+
+    // heroes scattered over the whole sim region, they all come in high frequency
+    RandomSeries series = random_seed(0x9E3779B9);
+    for (u32 i = 0; i < entity_count; ++i) {
+        s32 chunk_x = region.min_chunk_x + random_next_u32(&series) % (region.max_chunk_x - region.min_chunk_x);
+        s32 chunk_y = region.min_chunk_y + random_next_u32(&series) % (region.max_chunk_y - region.min_chunk_y);
+        V2 offset = 0.49f * world->chunk_side_in_meters * v2(random_bilateral(&series), random_bilateral(&series));
+        WorldPosition p = map_to_chunk_space(world, centered_chunk_point(chunk_x, chunk_y, region.chunk_z), offset);
+
+        add_low_entity(game_state, ET_HERO, &p);
+    }
+
+    InterleavedHighEntity* interleaved = (InterleavedHighEntity*)calloc(game_state->high_entity_count,
+                                                                        sizeof(InterleavedHighEntity));
+
+    u64 interleaved_cycles = 0;
+    u64 split_cycles = 0;
+    u64 grid_cycles = 0;
+    u64 move_cycles = 0;
+    u32 moves = 0;
+    for (u32 frame = 0; frame < frame_count; ++frame) {
+        V2 offset = 0.01f * v2(random_bilateral(&series), random_bilateral(&series));
+
+        u64 start = __rdtsc();
+        integrate_interleaved(interleaved, game_state->high_entity_count, offset, dt);
+        interleaved_cycles += __rdtsc() - start;
+
+        start = __rdtsc();
+        offset_high_entities(game_state, offset);
+        integrate_high_entity_z(&game_state->high_entities, game_state->high_entity_count, dt);
+        split_cycles += __rdtsc() - start;
+
+        start = __rdtsc();
+        rebuild_collision_grid(game_state);
+        grid_cycles += __rdtsc() - start;
+
+        start = __rdtsc();
+        for (u32 mover = 0; mover < mover_count; ++mover) {
+            // the first entities added, whatever high slot they sit in now
+            Entity entity = get_high_entity(game_state, 1 + mover);
+            if (!entity.high_index) continue;
+            V2 ddp = v2(random_bilateral(&series), random_bilateral(&series));
+            move_player(game_state, entity, dt, ddp);
+            ++moves;
+        }
+        move_cycles += __rdtsc() - start;
+    }
+
+    // the narrow phase on its own, over a full batch of the kind move_player packs
+    CollisionCandidates* candidates = &game_state->collision_candidates;
+    candidates->count = 0;
+    for (u32 i = 0; i < 32; ++i) {
+        u32 c = candidates->count++;
+        candidates->rel_x[c] = 3.0f * random_bilateral(&series);
+        candidates->rel_y[c] = 3.0f * random_bilateral(&series);
+        candidates->radius_x[c] = 1.0f;
+        candidates->radius_y[c] = 0.75f;
+        candidates->high_index[c] = c + 1;
+    }
+    pad_collision_candidates(candidates);
+
+    u32 narrow_iterations = 100000;
+    u64 narrow_scalar_cycles = 0;
+    u64 narrow_simd_cycles = 0;
+    u32 hit_sum = 0;
+    for (u32 i = 0; i < narrow_iterations; ++i) {
+        V2 delta = 0.1f * v2(random_bilateral(&series), random_bilateral(&series));
+
+        u64 start = __rdtsc();
+        hit_sum += find_earliest_hit_scalar(candidates, delta).hit_index;
+        narrow_scalar_cycles += __rdtsc() - start;
+
+        start = __rdtsc();
+        hit_sum += find_earliest_hit(candidates, delta).hit_index;
+        narrow_simd_cycles += __rdtsc() - start;
+    }
+
+    u32 high_count = game_state->high_entity_count - 1;
+    f64 entity_frames = (f64)high_count * frame_count;
+    printf("high entities:       %u (%u movers, %u frames)\n", high_count, mover_count, frame_count);
+    printf("offset + gravity:    %.2f cycles/entity interleaved, %.2f cycles/entity split arrays\n",
+           interleaved_cycles / entity_frames, split_cycles / entity_frames);
+    printf("grid rebuild:        %.2f cycles/entity\n", grid_cycles / entity_frames);
+    printf("move_player:         %.0f cycles/move\n", moves ? (f64)move_cycles / moves : 0.0);
+    printf("narrow phase:        %.0f cycles scalar, %.0f cycles sse for %u candidates (%u)\n",
+           (f64)narrow_scalar_cycles / narrow_iterations, (f64)narrow_simd_cycles / narrow_iterations,
+           candidates->count, hit_sum & 1);
+
+    return 0;
+}
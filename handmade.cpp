@@ -3,8 +3,15 @@
 #include "handmade_intrinsics.h"
 #include "handmade_world.h"
 #include "handmade_world.cpp"
-// TODO: remove this when we make our own rand func
-#include <stdlib.h>
+
+// set from GameMemory every frame, they don't survive a dll reload
+global platform_add_entry_func* platform_add_entry;
+global platform_complete_all_work_func* platform_complete_all_work;
+global platform_read_data_from_file_func* platform_read_data_from_file;
+global platform_write_data_to_file_func* platform_write_data_to_file;
+
+#include "handmade_render_group.cpp"
+#include "handmade_asset.cpp"
 
 #define TONE_HZ_START 256
 
@@ -32,197 +39,161 @@ internal void game_output_sound(GameState* game_state, GameOutputSoundBuffer* so
     }
 }
 
-internal void draw_rectangle(GameOffscreenBuffer* buffer,
-                             V2 v_min, V2 v_max,
-                             f32 r, f32 g, f32 b) {
-    int min_x = round_f32_to_s32(v_min.x);
-    int min_y = round_f32_to_s32(v_min.y);
-    int max_x = round_f32_to_s32(v_max.x);
-    int max_y = round_f32_to_s32(v_max.y);
+internal V2 get_high_p(HighEntities* high, u32 high_index) {
+    return v2(high->p_x[high_index], high->p_y[high_index]);
+}
 
-    if (min_x < 0) {
-        min_x = 0;
-    }
-    if (min_y < 0) {
-        min_y = 0;
-    }
-    if (max_x > buffer->width) {
-        max_x = buffer->width;
-    }
-    if (max_y > buffer->height) {
-        max_y = buffer->height;
-    }
-
-    u32 color = (round_f32_to_s32(r * 255.0f) << 16) |
-                (round_f32_to_s32(g * 255.0f) << 8) |
-                (round_f32_to_s32(b * 255.0f) << 0);
-
-    u8* row = (u8*)buffer->memory + (min_x * buffer->bytes_per_pixel) + (min_y * buffer->pitch);
-    for (s32 y = min_y; y < max_y; ++y) {
-        u32* pixel = (u32*)row;
-        for (s32 x = min_x; x < max_x; ++x) {
-            *pixel++ = color;
-        }
-        row += buffer->pitch;
-    }
-}
-
-internal void draw_bitmap(GameOffscreenBuffer* buffer, LoadedBitmap* bitmap,
-                          f32 real_x, f32 real_y,
-                          s32 align_x = 0, s32 align_y = 0,
-                          f32 c_alpha = 1.0f) {
-    real_x -= (f32)align_x;
-    real_y -= (f32)align_y;
-    s32 min_x = round_f32_to_s32(real_x);
-    s32 min_y = round_f32_to_s32(real_y);
-    s32 max_x = min_x + bitmap->width;
-    s32 max_y = min_y + bitmap->height;
-
-    s32 source_offset_x = 0;
-    if (min_x < 0) {
-        source_offset_x = -min_x;
-        min_x = 0;
-    }
-    s32 source_offset_y = 0;
-    if (min_y < 0) {
-        source_offset_y = -min_y;
-        min_y = 0;
-    }
-    if (max_x > buffer->width) {
-        max_x = buffer->width;
-    }
-    if (max_y > buffer->height) {
-        max_y = buffer->height;
-    }
-
-    u32* source_row = bitmap->pixels + (bitmap->width * (bitmap->height - 1));
-    source_row += -source_offset_y * bitmap->width + source_offset_x;
-    u8* dest_row = (u8*)buffer->memory + (min_x * buffer->bytes_per_pixel) + (min_y * buffer->pitch);
-    for (s32 y = min_y; y < max_y; ++y) {
-        u32* dest = (u32*)dest_row;
-        u32* source = source_row;
-        for (s32 x = min_x; x < max_x; ++x) {
-            f32 a = (f32)((*source >> 24) & 0xFF) / 255.0f;
-            a *= c_alpha;
-            f32 sr = (f32)((*source >> 16) & 0xFF);
-            f32 sg = (f32)((*source >> 8) & 0xFF);
-            f32 sb = (f32)((*source >> 0) & 0xFF);
-
-            f32 dr = (f32)((*dest >> 16) & 0xFF);
-            f32 dg = (f32)((*dest >> 8) & 0xFF);
-            f32 db = (f32)((*dest >> 0) & 0xFF);
-
-            f32 r = ((1.0f - a) * dr) + (a * sr);
-            f32 g = ((1.0f - a) * dg) + (a * sg);
-            f32 b = ((1.0f - a) * db) + (a * sb);
-
-            *dest = ((u32)(r + 0.5f) << 16) |
-                    ((u32)(g + 0.5f) << 8) |
-                    ((u32)(b + 0.5f) << 0);
-
-            ++dest;
-            ++source;
-        }
-        dest_row += buffer->pitch;
-        source_row -= bitmap->width;
-    }
-}
-
-#pragma pack(push, 1)
-struct BitmapHeader {
-    u16 file_type;
-    u32 file_size;
-    u16 reserved_1;
-    u16 reserved_2;
-    u32 bitmap_offset;
-    u32 size;
-    s32 width;
-    s32 height;
-    u16 planes;
-    u16 bits_per_pixel;
-    u32 compression;
-    u32 size_of_bitmap;
-    s32 horz_resolution;
-    s32 vert_resolution;
-    u32 colors_used;
-    u32 colors_important;
-
-    u32 red_mask;
-    u32 green_mask;
-    u32 blue_mask;
-};
-#pragma pack(pop)
+internal void set_high_p(HighEntities* high, u32 high_index, V2 p) {
+    high->p_x[high_index] = p.x;
+    high->p_y[high_index] = p.y;
+}
+
+internal V2 get_high_dp(HighEntities* high, u32 high_index) {
+    return v2(high->dp_x[high_index], high->dp_y[high_index]);
+}
+
+internal void set_high_dp(HighEntities* high, u32 high_index, V2 dp) {
+    high->dp_x[high_index] = dp.x;
+    high->dp_y[high_index] = dp.y;
+}
+
+internal V2 get_camera_space_p(GameState* game_state, LowEntity* low_entity) {
+    WorldPosition p = unpack_world_position(&low_entity->p);
+    WorldDifference diff = subtract(game_state->world, &p, &game_state->camera_p);
+    return diff.d_xy;
+}
 
-internal LoadedBitmap debug_load_bmp(ThreadContext* thread, debug_platform_read_entire_file_func* read_entire_file, char* filename) {
-    DebugReadFileResult read_result = read_entire_file(thread, filename);
-    assert(read_result.contents_size > 0);
+struct CollisionGridSpan {
+    s32 min_x;
+    s32 min_y;
+    s32 max_x;
+    s32 max_y;
+};
 
-    BitmapHeader* header = (BitmapHeader*)read_result.contents;
-    u32* pixels = (u32*)((u8*)read_result.contents + header->bitmap_offset);
+internal s32 get_collision_grid_cell(f32 value, f32 origin, f32 cell_side) {
+    s32 cell = floor_f32_to_s32((value - origin) / cell_side);
+    // out of range entities pile into the border cells, queries clamp the same way
+    if (cell < 0) cell = 0;
+    if (cell > COLLISION_GRID_DIM - 1) cell = COLLISION_GRID_DIM - 1;
+    return cell;
+}
 
-    assert(header->compression == 3);
+internal CollisionGridSpan get_collision_grid_span(CollisionGrid* grid, V2 min_p, V2 max_p) {
+    CollisionGridSpan result;
+    result.min_x = get_collision_grid_cell(min_p.x, grid->origin.x, grid->cell_side_in_meters);
+    result.min_y = get_collision_grid_cell(min_p.y, grid->origin.y, grid->cell_side_in_meters);
+    result.max_x = get_collision_grid_cell(max_p.x, grid->origin.x, grid->cell_side_in_meters);
+    result.max_y = get_collision_grid_cell(max_p.y, grid->origin.y, grid->cell_side_in_meters);
+    return result;
+}
 
-    // We want to conver the byte order to 0xAARRGGBB for compatibility with
-    // our blit. Bitmap goes from bottom to top.
-    u32 alpha_mask = ~(header->red_mask | header->green_mask | header->blue_mask);
+internal CollisionGridSpan get_collision_grid_span(GameState* game_state, LowEntity* low, V2 p) {
+    V2 half_dim = 0.5f * get_entity_dim(game_state, low);
+    CollisionGrid* grid = &game_state->collision_grid;
+    return get_collision_grid_span(grid, p - half_dim, p + half_dim);
+}
 
-    u32 red_shift = find_least_significant_set_bit(header->red_mask);
-    u32 green_shift = find_least_significant_set_bit(header->green_mask);
-    u32 blue_shift = find_least_significant_set_bit(header->blue_mask);
-    u32 alpha_shift = find_least_significant_set_bit(alpha_mask);
+internal void insert_into_collision_grid(GameState* game_state, u32 low_index, V2 p) {
+    CollisionGrid* grid = &game_state->collision_grid;
+    LowEntity* low = get_low_entity(game_state, low_index);
+    if (!grid->is_valid || !entity_collides(game_state, low)) return;
+
+    CollisionGridSpan span = get_collision_grid_span(game_state, low, p);
+    for (s32 cell_y = span.min_y; cell_y <= span.max_y; ++cell_y) {
+        for (s32 cell_x = span.min_x; cell_x <= span.max_x; ++cell_x) {
+            u32 node_index = grid->first_free_node;
+            if (node_index) {
+                grid->first_free_node = grid->nodes[node_index].next;
+            } else {
+                if (grid->node_count >= array_count(grid->nodes)) {
+                    // too crowded to track, queries fall back to testing every high entity
+                    grid->is_valid = false;
+                    return;
+                }
+                node_index = grid->node_count++;
+            }
 
-    u32* source_dest = pixels;
-    for (s32 y = 0; y < header->height; ++y) {
-        for (s32 x = 0; x < header->width; ++x) {
-            u32 c = *source_dest;
-            *source_dest++ = (((c >> alpha_shift) & 0xFF) << 24) |
-                             (((c >> red_shift) & 0xFF) << 16) |
-                             (((c >> green_shift) & 0xFF) << 8) |
-                             (((c >> blue_shift) & 0xFF) << 0);
+            u32* first = grid->first_node + cell_y * COLLISION_GRID_DIM + cell_x;
+            grid->nodes[node_index].low_entity_index = low_index;
+            grid->nodes[node_index].next = *first;
+            *first = node_index;
         }
     }
+}
 
-    LoadedBitmap bitmap = {};
-    bitmap.pixels = pixels;
-    bitmap.height = header->height;
-    bitmap.width = header->width;
-    return bitmap;
+internal void remove_from_collision_grid(GameState* game_state, u32 low_index, V2 p) {
+    CollisionGrid* grid = &game_state->collision_grid;
+    LowEntity* low = get_low_entity(game_state, low_index);
+    if (!grid->is_valid || !entity_collides(game_state, low)) return;
+
+    CollisionGridSpan span = get_collision_grid_span(game_state, low, p);
+    for (s32 cell_y = span.min_y; cell_y <= span.max_y; ++cell_y) {
+        for (s32 cell_x = span.min_x; cell_x <= span.max_x; ++cell_x) {
+            for (u32* link = grid->first_node + cell_y * COLLISION_GRID_DIM + cell_x; *link;
+                 link = &grid->nodes[*link].next) {
+                u32 node_index = *link;
+                if (grid->nodes[node_index].low_entity_index == low_index) {
+                    *link = grid->nodes[node_index].next;
+                    grid->nodes[node_index].next = grid->first_free_node;
+                    grid->first_free_node = node_index;
+                    break;
+                }
+            }
+        }
+    }
 }
 
-internal V2 get_camera_space_p(GameState* game_state, LowEntity* low_entity) {
-    WorldDifference diff = subtract(game_state->world, &low_entity->p, &game_state->camera_p);
-    return diff.d_xy;
+internal void rebuild_collision_grid(GameState* game_state) {
+    CollisionGrid* grid = &game_state->collision_grid;
+    grid->is_valid = true;
+    // two tiles, heroes then touch at most four cells
+    grid->cell_side_in_meters = 2.0f * game_state->world->tile_side_in_meters;
+    grid->origin = v2(-0.5f * COLLISION_GRID_DIM * grid->cell_side_in_meters,
+                      -0.5f * COLLISION_GRID_DIM * grid->cell_side_in_meters);
+    for (u32 i = 0; i < array_count(grid->first_node); ++i) {
+        grid->first_node[i] = 0;
+    }
+    grid->node_count = 1;
+    grid->first_free_node = 0;
+
+    HighEntities* high = &game_state->high_entities;
+    for (u32 high_index = 1; high_index < game_state->high_entity_count; ++high_index) {
+        insert_into_collision_grid(game_state, high->low_entity_index[high_index], get_high_p(high, high_index));
+    }
 }
 
-internal HighEntity* make_entity_high_freq(GameState* game_state, LowEntity* low_entity, u32 low_index, V2 camera_space_p) {
+internal u32 make_entity_high_freq(GameState* game_state, LowEntity* low_entity, u32 low_index, V2 camera_space_p) {
     assert(low_entity->high_entity_index == 0);
 
-    HighEntity* high_entity = NULL;
+    u32 high_index = 0;
     if (low_entity->high_entity_index == 0) {
-        if (game_state->high_entity_count >= array_count(game_state->high_entities_)) {
+        if (game_state->high_entity_count >= MAX_HIGH_ENTITY_COUNT) {
             INVALID_CODE_PATH;
         }
 
-        u32 high_index = game_state->high_entity_count++;
-        high_entity = game_state->high_entities_ + high_index;
+        HighEntities* high = &game_state->high_entities;
+        high_index = game_state->high_entity_count++;
 
-        high_entity->p = camera_space_p;
-        high_entity->dp = v2(0,0);
-        high_entity->chunk_z = low_entity->p.chunk_z;
-        high_entity->facing_direction = 0;
-        high_entity->low_entity_index = low_index;
+        set_high_p(high, high_index, camera_space_p);
+        set_high_dp(high, high_index, v2(0,0));
+        high->z[high_index] = 0;
+        high->dz[high_index] = 0;
+        high->chunk_z[high_index] = low_entity->p.chunk_z;
+        high->facing_direction[high_index] = 0;
+        high->low_entity_index[high_index] = low_index;
 
         low_entity->high_entity_index = high_index;
+        insert_into_collision_grid(game_state, low_index, camera_space_p);
     }
 
-    return high_entity;
+    return high_index;
 }
 
-internal HighEntity* make_entity_high_freq(GameState* game_state, u32 low_index) {
-    LowEntity* low_entity = game_state->low_entities + low_index;
+internal u32 make_entity_high_freq(GameState* game_state, u32 low_index) {
+    LowEntity* low_entity = get_low_entity(game_state, low_index);
 
     if (low_entity->high_entity_index) {
-        return game_state->high_entities_ + low_entity->high_entity_index;
+        return low_entity->high_entity_index;
     }
 
     V2 camera_space_p = get_camera_space_p(game_state, low_entity);
@@ -230,38 +201,37 @@ internal HighEntity* make_entity_high_freq(GameState* game_state, u32 low_index)
 }
 
 internal void make_entity_low_freq(GameState* game_state, u32 low_index) {
-    LowEntity* low_entity = game_state->low_entities + low_index;
+    LowEntity* low_entity = get_low_entity(game_state, low_index);
     u32 high_index = low_entity->high_entity_index;
     if (high_index == NULL) return;
 
+    HighEntities* high = &game_state->high_entities;
     u32 last_high_index = game_state->high_entity_count - 1;
-    HighEntity* del_entity = game_state->high_entities_ + high_index;
-    HighEntity* last_entity = game_state->high_entities_ + last_high_index;
 
-    *del_entity = *last_entity;
-    game_state->low_entities[last_entity->low_entity_index].high_entity_index = high_index;
+    remove_from_collision_grid(game_state, low_index, get_high_p(high, high_index));
+
+    high->p_x[high_index] = high->p_x[last_high_index];
+    high->p_y[high_index] = high->p_y[last_high_index];
+    high->dp_x[high_index] = high->dp_x[last_high_index];
+    high->dp_y[high_index] = high->dp_y[last_high_index];
+    high->z[high_index] = high->z[last_high_index];
+    high->dz[high_index] = high->dz[last_high_index];
+    high->facing_direction[high_index] = high->facing_direction[last_high_index];
+    high->chunk_z[high_index] = high->chunk_z[last_high_index];
+    high->low_entity_index[high_index] = high->low_entity_index[last_high_index];
+    get_low_entity(game_state, high->low_entity_index[high_index])->high_entity_index = high_index;
 
     --game_state->high_entity_count;
     low_entity->high_entity_index = 0;
 }
 
-internal LowEntity* get_low_entity(GameState* game_state, u32 index) {
-    LowEntity* result = 0;
-
-    if (index > 0 && index < game_state->low_entity_count) {
-        result = game_state->low_entities + index;
-    }
-
-    return result;
-}
-
 internal Entity get_high_entity(GameState* game_state, u32 low_index) {
     Entity result = {};
 
     if (low_index > 0 && low_index < game_state->low_entity_count) {
         result.low_index = low_index;
-        result.low = game_state->low_entities + low_index;
-        result.high = make_entity_high_freq(game_state, low_index);
+        result.low = get_low_entity(game_state, low_index);
+        result.high_index = make_entity_high_freq(game_state, low_index);
     }
 
     return result;
@@ -269,92 +239,628 @@ internal Entity get_high_entity(GameState* game_state, u32 low_index) {
 
 internal bool validate_entity_pairs(GameState* game_state) {
     for (u32 high_entity_index = 1; high_entity_index < game_state->high_entity_count; ++high_entity_index) {
-        HighEntity* high = game_state->high_entities_ + high_entity_index;
-        bool test = game_state->low_entities[high->low_entity_index].high_entity_index == high_entity_index;
+        u32 low_entity_index = game_state->high_entities.low_entity_index[high_entity_index];
+        bool test = get_low_entity(game_state, low_entity_index)->high_entity_index == high_entity_index;
         if (!test) return false;
     }
 
     return true;
 }
 
-internal void offset_and_check_frequency_by_area(GameState* game_state, V2 offset, Rect2 high_freq_bounds) {
-    for (u32 high_entity_index = 1; high_entity_index < game_state->high_entity_count;) {
-        HighEntity* high = game_state->high_entities_ + high_entity_index;
-        high->p += offset;
+// the null entity at 0 and the unused tail of the last vector get offset too, nobody reads them
+internal void offset_high_entities(GameState* game_state, V2 offset) {
+    HighEntities* high = &game_state->high_entities;
+    __m128 offset_x = _mm_set1_ps(offset.x);
+    __m128 offset_y = _mm_set1_ps(offset.y);
+    for (u32 high_index = 0; high_index < game_state->high_entity_count; high_index += 4) {
+        _mm_store_ps(high->p_x + high_index, _mm_add_ps(_mm_load_ps(high->p_x + high_index), offset_x));
+        _mm_store_ps(high->p_y + high_index, _mm_add_ps(_mm_load_ps(high->p_y + high_index), offset_y));
+    }
+}
 
-        if (is_in_rect(high_freq_bounds, high->p)) {
-            // make_entity_low_freq mutates array, advance index here
-            ++high_entity_index;
-        } else {
-            assert(game_state->low_entities[high->low_entity_index].high_entity_index == high_entity_index);
-            make_entity_low_freq(game_state, high->low_entity_index);
+// Same operations in the same order as the scalar version, so the results are bit identical.
+internal void integrate_high_entity_z(HighEntities* high, u32 high_entity_count, f32 dt) {
+    f32 ddz = -9.8f;
+    __m128 z_from_ddz = _mm_set1_ps(0.5f * ddz * square(dt));
+    __m128 dz_from_ddz = _mm_set1_ps(ddz * dt);
+    __m128 dt_4x = _mm_set1_ps(dt);
+    __m128 zero = _mm_setzero_ps();
+    for (u32 high_index = 0; high_index < high_entity_count; high_index += 4) {
+        __m128 z = _mm_load_ps(high->z + high_index);
+        __m128 dz = _mm_load_ps(high->dz + high_index);
+
+        z = _mm_add_ps(_mm_add_ps(z_from_ddz, _mm_mul_ps(dz, dt_4x)), z);
+        dz = _mm_add_ps(dz_from_ddz, dz);
+        // clamp with a mask rather than max so -0 stays -0 like the scalar compare
+        z = _mm_andnot_ps(_mm_cmplt_ps(z, zero), z);
+
+        _mm_store_ps(high->z + high_index, z);
+        _mm_store_ps(high->dz + high_index, dz);
+    }
+}
+
+#if HANDMADE_SLOW
+internal void integrate_high_entity_z_scalar(HighEntities* high, u32 high_entity_count, f32 dt) {
+    f32 ddz = -9.8f;
+    for (u32 high_index = 0; high_index < high_entity_count; ++high_index) {
+        high->z[high_index] = (0.5f * ddz * square(dt)) + (high->dz[high_index] * dt) + high->z[high_index];
+        high->dz[high_index] = (ddz * dt) + high->dz[high_index];
+        if (high->z[high_index] < 0) {
+            high->z[high_index] = 0;
+        }
+    }
+}
+#endif
+
+internal bool is_in_sim_region(SimChunkRegion* region, s32 chunk_x, s32 chunk_y, s32 chunk_z) {
+    return chunk_z == region->chunk_z &&
+           chunk_x >= region->min_chunk_x && chunk_x < region->max_chunk_x &&
+           chunk_y >= region->min_chunk_y && chunk_y < region->max_chunk_y;
+}
+
+internal void set_chunk_frequency(GameState* game_state, s32 chunk_x, s32 chunk_y, s32 chunk_z, bool high) {
+    WorldChunk* chunk = get_world_chunk(game_state->world, chunk_x, chunk_y, chunk_z);
+    if (!chunk) return;
+
+    for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
+        for (u32 entity_index_index = 0; entity_index_index < block->entity_count; ++entity_index_index) {
+            u32 low_entity_index = block->low_entity_index[entity_index_index];
+            if (high) {
+                make_entity_high_freq(game_state, low_entity_index);
+            } else {
+                make_entity_low_freq(game_state, low_entity_index);
+            }
         }
     }
 }
 
-internal u32 add_low_entity(GameState* game_state, EntityType type, WorldPosition* p) {
-    assert(game_state->low_entity_count < array_count(game_state->low_entities));
-    u32 entity_index = game_state->low_entity_count++;
+// Freed slots are reused first, a new page only comes off the world arena when the last one
+// is full. The size is in units of the type's template.
+internal u32 add_low_entity(GameState* game_state, EntityType type, WorldPosition* p,
+                            u32 size_x = 1, u32 size_y = 1) {
+    u32 entity_index = game_state->first_free_low_entity_index;
+    LowEntityPage* page = 0;
+    if (entity_index) {
+        page = get_low_entity_page(game_state, entity_index);
+        game_state->first_free_low_entity_index = page->cold[entity_index & LOW_ENTITY_PAGE_MASK].next_free;
+        --game_state->free_low_entity_count;
+    } else {
+        entity_index = game_state->low_entity_count++;
+        if ((entity_index >> LOW_ENTITY_PAGE_SHIFT) == game_state->low_entity_page_count) {
+            assert(game_state->low_entity_page_count < array_count(game_state->low_entity_pages));
+            game_state->low_entity_pages[game_state->low_entity_page_count++] =
+                push_struct(&game_state->world_arena, LowEntityPage);
+        }
+        page = get_low_entity_page(game_state, entity_index);
+        page->generation[entity_index & LOW_ENTITY_PAGE_MASK] = 0;
+    }
 
-    game_state->low_entities[entity_index] = {};
-    game_state->low_entities[entity_index].type = type;
+    assert(size_x <= 0xFF && size_y <= 0xFF);
+    LowEntity* low_entity = page->hot + (entity_index & LOW_ENTITY_PAGE_MASK);
+    *low_entity = {};
+    low_entity->type = (u8)type;
+    low_entity->size_x = (u8)size_x;
+    low_entity->size_y = (u8)size_y;
+    page->cold[entity_index & LOW_ENTITY_PAGE_MASK] = {};
 
     if (p) {
-        game_state->low_entities[entity_index].p = *p;
-        change_entity_location(&game_state->world_arena, game_state->world, entity_index, NULL, p);
+        low_entity->p = pack_world_position(p);
+        change_entity_location(game_state, entity_index, NULL, p);
+
+        if (is_in_sim_region(&game_state->sim_region, p->chunk_x, p->chunk_y, p->chunk_z)) {
+            make_entity_high_freq(game_state, entity_index);
+        }
     }
 
     return entity_index;
 }
 
+// the entity must already be out of its chunk and low frequency
+internal void free_low_entity(GameState* game_state, u32 entity_index) {
+    LowEntity* low_entity = get_low_entity(game_state, entity_index);
+    assert(low_entity && low_entity->type != ET_NULL && !low_entity->high_entity_index);
+
+    LowEntityPage* page = get_low_entity_page(game_state, entity_index);
+    u32 slot = entity_index & LOW_ENTITY_PAGE_MASK;
+    *low_entity = {};
+    page->cold[slot] = {};
+    page->cold[slot].next_free = game_state->first_free_low_entity_index;
+    ++page->generation[slot];
+    game_state->first_free_low_entity_index = entity_index;
+    ++game_state->free_low_entity_count;
+}
+
+// The world has to be there first, walls are sized in its tiles.
+internal void initialize_entity_templates(GameState* game_state) {
+    EntityTypeTemplate* hero = game_state->entity_templates + ET_HERO;
+    *hero = {};
+    hero->width = 1.0f;
+    hero->height = 0.5f;
+    hero->collides = true;
+
+    // walls collide through the chunk tile masks, not as entities
+    EntityTypeTemplate* wall = game_state->entity_templates + ET_WALL;
+    *wall = {};
+    wall->width = game_state->world->tile_side_in_meters;
+    wall->height = game_state->world->tile_side_in_meters;
+    wall->collides = false;
+}
+
 internal u32 add_player(GameState* game_state) {
     WorldPosition p = game_state->camera_p;
     u32 entity_index = add_low_entity(game_state, ET_HERO, &p);
-    LowEntity* low_entity = get_low_entity(game_state, entity_index);
 
-    low_entity->height = 0.5f;
-    low_entity->width = 1.0f;
-    low_entity->collides = true;
-
-    if (game_state->camera_following_entity_index == 0) {
-        game_state->camera_following_entity_index = entity_index;
+    if (get_low_entity_index(game_state, game_state->camera_following_entity_ref) == 0) {
+        game_state->camera_following_entity_ref = get_low_entity_reference(game_state, entity_index);
     }
 
     return entity_index;
 }
 
-internal u32 add_wall(GameState* game_state, s32 abs_tile_x, s32 abs_tile_y, s32 abs_tile_z) {
-    WorldPosition p = chunk_position_from_tile_position(game_state->world, abs_tile_x, abs_tile_y, abs_tile_z);
-    u32 entity_index = add_low_entity(game_state, ET_WALL, &p);
-    LowEntity* low_entity = get_low_entity(game_state, entity_index);
+// A rectangle of wall tiles, which have to be in the same chunk. The tiles go into the chunk's
+// tile mask for collision, the entity is only there to draw them.
+internal u32 add_wall(GameState* game_state, s32 abs_tile_x, s32 abs_tile_y, s32 abs_tile_z,
+                      u32 tile_count_x = 1, u32 tile_count_y = 1) {
+    World* world = game_state->world;
+    for (u32 tile_y = 0; tile_y < tile_count_y; ++tile_y) {
+        for (u32 tile_x = 0; tile_x < tile_count_x; ++tile_x) {
+            set_wall_tile(world, &game_state->world_arena, abs_tile_x + tile_x, abs_tile_y + tile_y, abs_tile_z);
+        }
+    }
 
-    low_entity->height = game_state->world->tile_side_in_meters;
-    low_entity->width = low_entity->height;
-    low_entity->collides = true;
+    WorldPosition p = chunk_position_from_tile_position(world, abs_tile_x, abs_tile_y, abs_tile_z);
+    p.offset_x += (tile_count_x - 1) << (WORLD_TILE_SHIFT - 1);
+    p.offset_y += (tile_count_y - 1) << (WORLD_TILE_SHIFT - 1);
+    recanonicalize_coord(&p.chunk_x, &p.offset_x);
+    recanonicalize_coord(&p.chunk_y, &p.offset_y);
+    return add_low_entity(game_state, ET_WALL, &p, tile_count_x, tile_count_y);
+}
 
-    return entity_index;
+// Greedy, row by row: take the first run of wall tiles in a row and grow it down for as long
+// as the rows below have the whole run. Room borders come out as one rectangle per side.
+internal u32 add_merged_walls(GameState* game_state, WorldChunk* chunk) {
+    u16 rows[TILES_PER_CHUNK];
+    for (u32 row = 0; row < TILES_PER_CHUNK; ++row) {
+        rows[row] = chunk->wall_tile_rows[row];
+    }
+
+    u32 wall_count = 0;
+    for (u32 tile_y = 0; tile_y < TILES_PER_CHUNK; ++tile_y) {
+        while (rows[tile_y]) {
+            u32 tile_x = find_least_significant_set_bit(rows[tile_y]);
+            u32 tile_count_x = find_least_significant_set_bit(~((u32)rows[tile_y] >> tile_x));
+            u16 run = (u16)(((1u << tile_count_x) - 1) << tile_x);
+
+            rows[tile_y] &= ~run;
+            u32 tile_count_y = 1;
+            while (tile_y + tile_count_y < TILES_PER_CHUNK && (rows[tile_y + tile_count_y] & run) == run) {
+                rows[tile_y + tile_count_y] &= ~run;
+                ++tile_count_y;
+            }
+
+            add_wall(game_state,
+                     chunk->chunk_x * TILES_PER_CHUNK + tile_x,
+                     chunk->chunk_y * TILES_PER_CHUNK + tile_y,
+                     chunk->chunk_z * TILES_PER_CHUNK,
+                     tile_count_x, tile_count_y);
+            ++wall_count;
+        }
+    }
+
+    return wall_count;
 }
 
-internal bool test_wall(f32 wall_x, f32 rel_x, f32 rel_y,
-                        f32 player_delta_x, f32 player_delta_y,
-                        f32* t_min, f32 min_y, f32 max_y)
-{
-    bool hit = false;;
-    f32 t_epsilon = 0.001f;
-    if (player_delta_x != 0.0f) {
-        f32 t_result = (wall_x - rel_x) / player_delta_x;
-        f32 y = rel_y + t_result * player_delta_y;
-        if (t_result >= 0.0f && *t_min > t_result && y >= min_y && y <= max_y) {
-            hit = true;
-            *t_min = max(0.0f, t_result - t_epsilon);
+internal void initialize_world_generator(WorldGenerator* generator, PlatformWorkQueue* queue, u32 room_count, u32 seed) {
+    *generator = {};
+    generator->queue = queue;
+    generator->series = random_seed(seed);
+    generator->room_count = room_count;
+}
+
+// Serial, since every room's doors depend on the one before. The room is added to every chunk
+// it overlaps, creating them if needed, so generation never has to search for its rooms.
+internal void lay_out_next_room(World* world, MemoryArena* arena, WorldGenerator* generator) {
+    assert(generator->rooms_laid_out < generator->room_count);
+    ++generator->rooms_laid_out;
+
+    s32 screen_base_z = 0;
+    s32 abs_tile_z = generator->abs_tile_z;
+
+    // TODO up and down doors, choosing from 3 here once avoiding up -> down -> up
+    u32 choice = random_choice(&generator->series, 2);
+
+    WorldRoom* room = push_struct(arena, WorldRoom);
+    *room = {};
+    room->screen_x = generator->screen_x;
+    room->screen_y = generator->screen_y;
+    room->abs_tile_z = abs_tile_z;
+    room->door_left = generator->door_left;
+    room->door_bottom = generator->door_bottom;
+    room->door_top = choice == 0;
+    room->door_right = choice == 1;
+    room->door_up = generator->door_up || (choice == 2 && abs_tile_z == screen_base_z);
+    room->door_down = generator->door_down || (choice == 2 && abs_tile_z != screen_base_z);
+
+    s32 min_tile_x = room->screen_x * ROOM_TILE_COUNT_X;
+    s32 min_tile_y = room->screen_y * ROOM_TILE_COUNT_Y;
+    s32 min_chunk_x = min_tile_x >> TILE_CHUNK_SHIFT;
+    s32 min_chunk_y = min_tile_y >> TILE_CHUNK_SHIFT;
+    s32 max_chunk_x = (min_tile_x + ROOM_TILE_COUNT_X - 1) >> TILE_CHUNK_SHIFT;
+    s32 max_chunk_y = (min_tile_y + ROOM_TILE_COUNT_Y - 1) >> TILE_CHUNK_SHIFT;
+    assert(max_chunk_x - min_chunk_x < ROOM_CHUNK_SPAN_X && max_chunk_y - min_chunk_y < ROOM_CHUNK_SPAN_Y);
+    for (s32 chunk_y = min_chunk_y; chunk_y <= max_chunk_y; ++chunk_y) {
+        for (s32 chunk_x = min_chunk_x; chunk_x <= max_chunk_x; ++chunk_x) {
+            WorldChunk* chunk = get_world_chunk(world, chunk_x, chunk_y, abs_tile_z >> TILE_CHUNK_SHIFT, arena);
+            // the camera only ever asks for chunks behind the frontier of the walk
+            assert(!chunk->generated);
+            assert(chunk->room_count < array_count(chunk->rooms));
+            chunk->rooms[chunk->room_count++] = room;
+            room->chunks[chunk_y - min_chunk_y][chunk_x - min_chunk_x] = chunk;
         }
     }
 
-    return hit;
+    if (choice == 0) {
+        generator->screen_y += 1;
+    } else if (choice == 1) {
+        generator->screen_x += 1;
+    } else if (choice == 2) {
+        generator->abs_tile_z = (abs_tile_z == screen_base_z) ? screen_base_z + 1 : screen_base_z;
+    }
+    generator->door_left = room->door_right;
+    generator->door_bottom = room->door_top;
+    if (choice == 2) {
+        generator->door_up = !room->door_up;
+        generator->door_down = !room->door_down;
+    } else {
+        generator->door_up = false;
+        generator->door_down = false;
+    }
+}
+
+internal void emit_room_walls(WorldRoom* room) {
+    s32 min_tile_x = room->screen_x * ROOM_TILE_COUNT_X;
+    s32 min_tile_y = room->screen_y * ROOM_TILE_COUNT_Y;
+    for (s32 tile_y = 0; tile_y < ROOM_TILE_COUNT_Y; ++tile_y) {
+        for (s32 tile_x = 0; tile_x < ROOM_TILE_COUNT_X; ++tile_x) {
+            s32 abs_tile_x = min_tile_x + tile_x;
+            s32 abs_tile_y = min_tile_y + tile_y;
+
+            u32 tile_value = 1;
+
+            // left side
+            if (tile_x == 0 && !(room->door_left && tile_y == ROOM_TILE_COUNT_Y / 2)) {
+                tile_value = 2;
+            }
+            // right side
+            if ((tile_x == ROOM_TILE_COUNT_X - 1) && !(room->door_right && tile_y == ROOM_TILE_COUNT_Y / 2)) {
+                tile_value = 2;
+            }
+            // bottom side
+            if (tile_y == 0 && !(room->door_bottom && tile_x == ROOM_TILE_COUNT_X / 2)) {
+                tile_value = 2;
+            }
+            // top side
+            if ((tile_y == ROOM_TILE_COUNT_Y - 1) && !(room->door_top && tile_x == ROOM_TILE_COUNT_X / 2)) {
+                tile_value = 2;
+            }
+
+            if (tile_x == 10 && tile_y == 6) {
+                if (room->door_up) {
+                    tile_value = 3;
+                } else if (room->door_down) {
+                    tile_value = 4;
+                }
+            }
+
+            if (tile_value == 2) {
+                WorldChunk* chunk = room->chunks[(abs_tile_y >> TILE_CHUNK_SHIFT) - (min_tile_y >> TILE_CHUNK_SHIFT)]
+                                                [(abs_tile_x >> TILE_CHUNK_SHIFT) - (min_tile_x >> TILE_CHUNK_SHIFT)];
+                set_wall_tile_in_chunk(chunk, abs_tile_x, abs_tile_y);
+            }
+        }
+    }
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(emit_room_walls_work) {
+    emit_room_walls((WorldRoom*)data);
+}
+
+// Lays out the walk until it is past the region, then generates the chunks in the region that
+// haven't been. Rooms can be shared between chunks and only OR bits into the chunk masks, so
+// they are emitted in parallel, and the wall entities are added serially after. The world for
+// a seed doesn't depend on the worker count or on the path the camera takes to get anywhere.
+internal void generate_world_chunks(GameState* game_state, SimChunkRegion* region) {
+    World* world = game_state->world;
+    MemoryArena* arena = &game_state->world_arena;
+    WorldGenerator* generator = &game_state->world_generator;
+
+    // rooms only move up and right, once the next one starts past the region all the rest do
+    s32 max_tile_x = region->max_chunk_x * TILES_PER_CHUNK - 1;
+    s32 max_tile_y = region->max_chunk_y * TILES_PER_CHUNK - 1;
+    while (generator->rooms_laid_out < generator->room_count &&
+           generator->screen_x * ROOM_TILE_COUNT_X <= max_tile_x &&
+           generator->screen_y * ROOM_TILE_COUNT_Y <= max_tile_y) {
+        lay_out_next_room(world, arena, generator);
+    }
+
+    bool any_emitted = false;
+    for (s32 chunk_y = region->min_chunk_y; chunk_y < region->max_chunk_y; ++chunk_y) {
+        for (s32 chunk_x = region->min_chunk_x; chunk_x < region->max_chunk_x; ++chunk_x) {
+            WorldChunk* chunk = get_world_chunk(world, chunk_x, chunk_y, region->chunk_z);
+            if (!chunk || chunk->generated) continue;
+
+            for (u32 room_index = 0; room_index < chunk->room_count; ++room_index) {
+                WorldRoom* room = chunk->rooms[room_index];
+                if (!room->walls_emitted) {
+                    room->walls_emitted = true;
+                    any_emitted = true;
+                    if (generator->queue) {
+                        platform_add_entry(generator->queue, emit_room_walls_work, room);
+                    } else {
+                        emit_room_walls(room);
+                    }
+                }
+            }
+        }
+    }
+    if (any_emitted && generator->queue) {
+        platform_complete_all_work(generator->queue);
+    }
+
+    for (s32 chunk_y = region->min_chunk_y; chunk_y < region->max_chunk_y; ++chunk_y) {
+        for (s32 chunk_x = region->min_chunk_x; chunk_x < region->max_chunk_x; ++chunk_x) {
+            WorldChunk* chunk = get_world_chunk(world, chunk_x, chunk_y, region->chunk_z);
+            if (!chunk || chunk->generated) continue;
+
+            add_merged_walls(game_state, chunk);
+            chunk->generated = true;
+            // its rooms are done with it, nothing follows the pointers after this
+            chunk->room_count = 0;
+            chunk->last_near_frame = game_state->frame_index;
+        }
+    }
+}
+
+enum CollisionWall {
+    CW_MIN_X,
+    CW_MAX_X,
+    CW_MIN_Y,
+    CW_MAX_Y,
+
+    CW_COUNT,
+};
+
+global V2 collision_wall_normals[CW_COUNT] = {
+    {-1, 0},
+    {1, 0},
+    {0, -1},
+    {0, 1},
+};
+
+// hit_index is candidate * CW_COUNT + wall, or UINT32_MAX when nothing is hit before t = 1
+struct NarrowPhaseHit {
+    f32 t;
+    u32 hit_index;
+};
+
+// Earliest hit over every wall of every candidate, ties go to the lowest hit_index. Unlike
+// nudging t_min back by the epsilon after each hit, this doesn't depend on the order the
+// walls are visited in, which is what lets the SIMD version match it exactly.
+internal NarrowPhaseHit find_earliest_hit_scalar(CollisionCandidates* candidates, V2 delta) {
+    NarrowPhaseHit result = {1.0f, UINT32_MAX};
+    for (u32 candidate = 0; candidate < candidates->count; ++candidate) {
+        f32 rel_x = candidates->rel_x[candidate];
+        f32 rel_y = candidates->rel_y[candidate];
+        f32 radius_x = candidates->radius_x[candidate];
+        f32 radius_y = candidates->radius_y[candidate];
+
+        for (u32 wall = 0; wall < CW_COUNT; ++wall) {
+            bool along_x = wall < CW_MIN_Y;
+            f32 wall_p = along_x ? radius_x : radius_y;
+            if (wall == CW_MIN_X || wall == CW_MIN_Y) {
+                wall_p = -wall_p;
+            }
+            f32 rel_a = along_x ? rel_x : rel_y;
+            f32 rel_b = along_x ? rel_y : rel_x;
+            f32 delta_a = along_x ? delta.x : delta.y;
+            f32 delta_b = along_x ? delta.y : delta.x;
+            f32 radius_b = along_x ? radius_y : radius_x;
+
+            if (delta_a != 0.0f) {
+                f32 t = (wall_p - rel_a) / delta_a;
+                f32 b = rel_b + t * delta_b;
+                if (t >= 0.0f && t < result.t && b >= -radius_b && b <= radius_b) {
+                    result.t = t;
+                    result.hit_index = candidate * CW_COUNT + wall;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// Four candidates per iteration, each lane keeps its own earliest hit and the lanes are
+// reduced at the end. Every lane sees its candidates in order, so ties resolve like the
+// scalar loop as long as the reduction prefers the lower hit_index.
+internal NarrowPhaseHit find_earliest_hit(CollisionCandidates* candidates, V2 delta) {
+    __m128 zero = _mm_setzero_ps();
+    __m128 delta_x = _mm_set1_ps(delta.x);
+    __m128 delta_y = _mm_set1_ps(delta.y);
+    __m128 x_moves = _mm_cmpneq_ps(delta_x, zero);
+    __m128 y_moves = _mm_cmpneq_ps(delta_y, zero);
+
+    __m128 best_t = _mm_set1_ps(1.0f);
+    __m128i best_index = _mm_set1_epi32(-1);
+    __m128i hit_index = _mm_setr_epi32(0, CW_COUNT, 2 * CW_COUNT, 3 * CW_COUNT);
+    __m128i hit_index_step = _mm_set1_epi32(4 * CW_COUNT);
+
+#define NARROW_PHASE_WALL(wall_p, rel_a, rel_b, delta_a, delta_b, min_b, max_b, moves, wall)        \
+    {                                                                                               \
+        __m128 t = _mm_div_ps(_mm_sub_ps(wall_p, rel_a), delta_a);                                  \
+        __m128 b = _mm_add_ps(rel_b, _mm_mul_ps(t, delta_b));                                       \
+        __m128 hit = _mm_and_ps(moves, _mm_cmpge_ps(t, zero));                                      \
+        hit = _mm_and_ps(hit, _mm_cmplt_ps(t, best_t));                                             \
+        hit = _mm_and_ps(hit, _mm_cmpge_ps(b, min_b));                                              \
+        hit = _mm_and_ps(hit, _mm_cmple_ps(b, max_b));                                              \
+        best_t = _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, best_t));                         \
+        __m128i hit_i = _mm_castps_si128(hit);                                                      \
+        __m128i index = _mm_add_epi32(hit_index, _mm_set1_epi32(wall));                             \
+        best_index = _mm_or_si128(_mm_and_si128(hit_i, index), _mm_andnot_si128(hit_i, best_index)); \
+    }
+
+    for (u32 candidate = 0; candidate < candidates->count; candidate += 4) {
+        __m128 rel_x = _mm_load_ps(candidates->rel_x + candidate);
+        __m128 rel_y = _mm_load_ps(candidates->rel_y + candidate);
+        __m128 radius_x = _mm_load_ps(candidates->radius_x + candidate);
+        __m128 radius_y = _mm_load_ps(candidates->radius_y + candidate);
+        // flip the sign bit, the scalar side negates and 0 - r would differ from it for r = 0
+        __m128 min_x = _mm_xor_ps(radius_x, _mm_set1_ps(-0.0f));
+        __m128 min_y = _mm_xor_ps(radius_y, _mm_set1_ps(-0.0f));
+
+        NARROW_PHASE_WALL(min_x, rel_x, rel_y, delta_x, delta_y, min_y, radius_y, x_moves, CW_MIN_X);
+        NARROW_PHASE_WALL(radius_x, rel_x, rel_y, delta_x, delta_y, min_y, radius_y, x_moves, CW_MAX_X);
+        NARROW_PHASE_WALL(min_y, rel_y, rel_x, delta_y, delta_x, min_x, radius_x, y_moves, CW_MIN_Y);
+        NARROW_PHASE_WALL(radius_y, rel_y, rel_x, delta_y, delta_x, min_x, radius_x, y_moves, CW_MAX_Y);
+
+        hit_index = _mm_add_epi32(hit_index, hit_index_step);
+    }
+#undef NARROW_PHASE_WALL
+
+    f32 lane_t[4];
+    u32 lane_index[4];
+    _mm_storeu_ps(lane_t, best_t);
+    _mm_storeu_si128((__m128i*)lane_index, best_index);
+
+    NarrowPhaseHit result = {1.0f, UINT32_MAX};
+    for (u32 lane = 0; lane < 4; ++lane) {
+        if (lane_index[lane] != UINT32_MAX &&
+            (lane_t[lane] < result.t || (lane_t[lane] == result.t && lane_index[lane] < result.hit_index))) {
+            result.t = lane_t[lane];
+            result.hit_index = lane_index[lane];
+        }
+    }
+
+    return result;
+}
+
+// pads to a whole vector with candidates whose ranges are empty, so no lane can report them
+internal void pad_collision_candidates(CollisionCandidates* candidates) {
+    while (candidates->count & 3) {
+        u32 pad = candidates->count++;
+        candidates->rel_x[pad] = 0.0f;
+        candidates->rel_y[pad] = 0.0f;
+        candidates->radius_x[pad] = -1.0f;
+        candidates->radius_y[pad] = -1.0f;
+        candidates->high_index[pad] = 0;
+    }
+}
+
+// Colliding high entities whose grid cells touch the bounds swept by the move, in high index
+// order so ties on t resolve the same way a scan over every high entity would.
+internal u32 gather_collision_candidates(GameState* game_state, Entity entity, V2 p, V2 player_delta,
+                                         u32* candidates, u32 max_candidates) {
+    CollisionGrid* grid = &game_state->collision_grid;
+    u32 mover_high_index = entity.high_index;
+
+    u32 count = 0;
+    if (grid->is_valid) {
+        V2 half_dim = 0.5f * get_entity_dim(game_state, entity.low);
+        V2 min_p = v2(min(p.x, p.x + player_delta.x), min(p.y, p.y + player_delta.y)) - half_dim;
+        V2 max_p = v2(max(p.x, p.x + player_delta.x), max(p.y, p.y + player_delta.y)) + half_dim;
+
+        CollisionGridSpan span = get_collision_grid_span(grid, min_p, max_p);
+        for (s32 cell_y = span.min_y; cell_y <= span.max_y; ++cell_y) {
+            for (s32 cell_x = span.min_x; cell_x <= span.max_x; ++cell_x) {
+                for (u32 node_index = grid->first_node[cell_y * COLLISION_GRID_DIM + cell_x]; node_index;
+                     node_index = grid->nodes[node_index].next) {
+                    u32 high_index = get_low_entity(game_state, grid->nodes[node_index].low_entity_index)->high_entity_index;
+                    assert(high_index);
+                    if (high_index == mover_high_index) continue;
+
+                    // insertion keeps the list sorted and drops entities seen in an earlier cell
+                    u32 insert_at = count;
+                    while (insert_at > 0 && candidates[insert_at - 1] > high_index) {
+                        --insert_at;
+                    }
+                    if (insert_at > 0 && candidates[insert_at - 1] == high_index) continue;
+
+                    assert(count < max_candidates);
+                    for (u32 i = count; i > insert_at; --i) {
+                        candidates[i] = candidates[i - 1];
+                    }
+                    candidates[insert_at] = high_index;
+                    ++count;
+                }
+            }
+        }
+    } else {
+        for (u32 high_index = 1; high_index < game_state->high_entity_count; ++high_index) {
+            if (high_index == mover_high_index) continue;
+            candidates[count++] = high_index;
+        }
+    }
+
+    return count;
+}
+
+// Appends a candidate for every run of wall tiles in a row near the bounds swept by the move,
+// straight from the chunk tile masks. The tile range and the wall centers are worked out in
+// world units from the camera chunk, so they are exact.
+internal void gather_wall_tile_candidates(GameState* game_state, Entity entity, V2 p, V2 player_delta,
+                                          CollisionCandidates* candidates) {
+    World* world = game_state->world;
+    WorldPosition* camera_p = &game_state->camera_p;
+    f32 tile_side = world->tile_side_in_meters;
+
+    V2 entity_dim = get_entity_dim(game_state, entity.low);
+    V2 half_dim = 0.5f * entity_dim;
+    V2 min_p = v2(min(p.x, p.x + player_delta.x), min(p.y, p.y + player_delta.y)) - half_dim;
+    V2 max_p = v2(max(p.x, p.x + player_delta.x), max(p.y, p.y + player_delta.y)) + half_dim;
+    WorldPosition min_world_p = map_to_chunk_space(world, *camera_p, min_p);
+    WorldPosition max_world_p = map_to_chunk_space(world, *camera_p, max_p);
+
+    // one tile of slack on each side so walls the mover is touching are tested too
+    s32 min_tile_x = get_abs_tile(min_world_p.chunk_x, min_world_p.offset_x) - 1;
+    s32 min_tile_y = get_abs_tile(min_world_p.chunk_y, min_world_p.offset_y) - 1;
+    s32 max_tile_x = get_abs_tile(max_world_p.chunk_x, max_world_p.offset_x) + 1;
+    s32 max_tile_y = get_abs_tile(max_world_p.chunk_y, max_world_p.offset_y) + 1;
+    s32 abs_tile_z = entity.low->p.chunk_z * TILES_PER_CHUNK;
+
+    s32 camera_tile_x = camera_p->chunk_x * TILES_PER_CHUNK;
+    s32 camera_tile_y = camera_p->chunk_y * TILES_PER_CHUNK;
+    for (s32 tile_y = min_tile_y; tile_y <= max_tile_y; ++tile_y) {
+        s32 wall_y_units = (tile_y - camera_tile_y) * (1 << WORLD_TILE_SHIFT) - camera_p->offset_y;
+        f32 wall_y = world->meters_per_unit * (f32)wall_y_units;
+        for (s32 first_tile_x = min_tile_x; first_tile_x <= max_tile_x; first_tile_x += 31) {
+            u32 tile_count = min(31, max_tile_x - first_tile_x + 1);
+            u32 bits = get_wall_tile_bits(world, first_tile_x, tile_y, abs_tile_z, tile_count);
+            while (bits) {
+                u32 run_start = find_least_significant_set_bit(bits);
+                u32 run_length = find_least_significant_set_bit(~(bits >> run_start));
+                bits &= ~(((1u << run_length) - 1) << run_start);
+
+                s32 wall_x_units = (first_tile_x + (s32)run_start - camera_tile_x) * (1 << WORLD_TILE_SHIFT) +
+                                   (s32)((run_length - 1) << (WORLD_TILE_SHIFT - 1)) - camera_p->offset_x;
+                f32 wall_x = world->meters_per_unit * (f32)wall_x_units;
+
+                assert(candidates->count < MAX_HIGH_ENTITY_COUNT);
+                u32 packed = candidates->count++;
+                candidates->rel_x[packed] = p.x - wall_x;
+                candidates->rel_y[packed] = p.y - wall_y;
+                candidates->radius_x[packed] = 0.5f * ((f32)run_length * tile_side + entity_dim.x);
+                candidates->radius_y[packed] = 0.5f * (tile_side + entity_dim.y);
+                candidates->high_index[packed] = 0;
+            }
+        }
+    }
 }
 
 internal void move_player(GameState* game_state, Entity entity, f32 dt, V2 ddp) {
     World* world = game_state->world;
+    HighEntities* high = &game_state->high_entities;
+    V2 p = get_high_p(high, entity.high_index);
+    V2 dp = get_high_dp(high, entity.high_index);
 
     f32 ddp_length = length_sq(ddp);
     if (ddp_length > 1.0f) {
@@ -364,14 +870,14 @@ internal void move_player(GameState* game_state, Entity entity, f32 dt, V2 ddp)
     f32 player_speed = 50.0f;
     ddp *= player_speed;
     // friction
-    ddp += -8.0f * entity.high->dp;
+    ddp += -8.0f * dp;
 
-    V2 old_player_p = entity.high->p;
+    V2 old_player_p = p;
     // p' = (1/2 * a * t^2) + (v * t) + p
     V2 player_delta = (0.5f * ddp * square(dt)) +
-                      (entity.high->dp * dt);
+                      (dp * dt);
     // v' = a * t + v
-    entity.high->dp = ddp * dt + entity.high->dp;
+    dp = ddp * dt + dp;
 
     V2 new_player_p = old_player_p + player_delta;
 
@@ -392,293 +898,670 @@ internal void move_player(GameState* game_state, Entity entity, f32 dt, V2 ddp)
     u32 abs_tile_z = entity->p.abs_tile_z;
     */
 
+    V2 entity_dim = get_entity_dim(game_state, entity.low);
+    CollisionCandidates* candidates = &game_state->collision_candidates;
     f32 t_remaining = 1.0f;
     for (u32 i = 0; i < 4 && t_remaining > 0.0f; ++i) {
+        u32 candidate_count = gather_collision_candidates(game_state, entity, p, player_delta,
+                                                          candidates->high_index, MAX_HIGH_ENTITY_COUNT);
+
+        // compacted in place, so the packed order is still high index order
+        candidates->count = 0;
+        for (u32 candidate_index = 0; candidate_index < candidate_count; ++candidate_index) {
+            u32 test_high_entity_index = candidates->high_index[candidate_index];
+            LowEntity* test_low = get_low_entity(game_state, high->low_entity_index[test_high_entity_index]);
+            if (entity_collides(game_state, test_low)) {
+                V2 test_dim = get_entity_dim(game_state, test_low);
+                f32 diameter_w = test_dim.x + entity_dim.x;
+                f32 diameter_h = test_dim.y + entity_dim.y;
+                V2 rel = p - get_high_p(high, test_high_entity_index);
+
+                u32 packed = candidates->count++;
+                candidates->rel_x[packed] = rel.x;
+                candidates->rel_y[packed] = rel.y;
+                candidates->radius_x[packed] = 0.5f * diameter_w;
+                candidates->radius_y[packed] = 0.5f * diameter_h;
+                candidates->high_index[packed] = test_high_entity_index;
+            }
+        }
+        // wall tiles go after the entities and have no high index
+        gather_wall_tile_candidates(game_state, entity, p, player_delta, candidates);
+        pad_collision_candidates(candidates);
+
         f32 t_min = 1.0f;
         V2 wall_normal = {};
-        u32 hit_high_entity_index = 0;
-        for (u32 test_high_entity_index = 1; test_high_entity_index < game_state->high_entity_count; ++test_high_entity_index) {
-            if (test_high_entity_index == entity.low->high_entity_index) continue;
-
-            Entity test_entity;
-            test_entity.high = game_state->high_entities_ + test_high_entity_index;
-            test_entity.low_index = test_entity.high->low_entity_index;
-            test_entity.low = game_state->low_entities + test_entity.low_index;
-            if (test_entity.low->collides) {
-                f32 diameter_w = test_entity.low->width + entity.low->width;
-                f32 diameter_h = test_entity.low->height + entity.low->height;
-
-                V2 min_corner = -0.5f * v2(diameter_w, diameter_h);
-                V2 max_corner = 0.5f * v2(diameter_w, diameter_h);
-
-                V2 rel = entity.high->p - test_entity.high->p;
-
-                if (test_wall(min_corner.x,
-                              rel.x, rel.y, player_delta.x, player_delta.y,
-                              &t_min, min_corner.y, max_corner.y))
-                {
-                    wall_normal = v2(-1, 0);
-                    hit_high_entity_index = test_high_entity_index;
-                }
-                if (test_wall(max_corner.x,
-                              rel.x, rel.y, player_delta.x, player_delta.y,
-                              &t_min, min_corner.y, max_corner.y))
-                {
-                    wall_normal = v2(1, 0);
-                    hit_high_entity_index = test_high_entity_index;
-                }
-                if (test_wall(min_corner.y,
-                              rel.y, rel.x, player_delta.y, player_delta.x,
-                              &t_min, min_corner.x, max_corner.x))
-                {
-                    wall_normal = v2(0, -1);
-                    hit_high_entity_index = test_high_entity_index;
-                }
-                if (test_wall(max_corner.y,
-                              rel.y, rel.x, player_delta.y, player_delta.x,
-                              &t_min, min_corner.x, max_corner.x))
-                {
-                    wall_normal = v2(0, 1);
-                    hit_high_entity_index = test_high_entity_index;
-                }
-            }
+        NarrowPhaseHit hit = find_earliest_hit(candidates, player_delta);
+        if (hit.hit_index != UINT32_MAX) {
+            f32 t_epsilon = 0.001f;
+            t_min = max(0.0f, hit.t - t_epsilon);
+            wall_normal = collision_wall_normals[hit.hit_index % CW_COUNT];
         }
 
-        entity.high->p += t_min * player_delta;
-        if (hit_high_entity_index) {
-            entity.high->dp = entity.high->dp - (1 * inner(entity.high->dp, wall_normal) * wall_normal);
+        p += t_min * player_delta;
+        if (hit.hit_index != UINT32_MAX) {
+            dp = dp - (1 * inner(dp, wall_normal) * wall_normal);
             player_delta = player_delta - (1 * inner(player_delta, wall_normal) * wall_normal);
             t_remaining -= (t_min * t_remaining);
 
-            HighEntity* hit_high = game_state->high_entities_ + hit_high_entity_index;
-            LowEntity* hit_low = game_state->low_entities + hit_high->low_entity_index;
             // TODO stairs
+            // u32 hit_high_entity_index = candidates->high_index[hit.hit_index / CW_COUNT];
             // entity.high->abs_tile_z += hit_low->d_abs_tile_z;
         } else {
             break;
         }
     }
 
-    if (entity.high->dp.x == 0.0f && entity.high->dp.y == 0.0f) {
+    if (dp.x == 0.0f && dp.y == 0.0f) {
         // leave facing direction as it was
-    } else if (absolute_value(entity.high->dp.x) > absolute_value(entity.high->dp.y)) {
-        if (entity.high->dp.x > 0) {
-            entity.high->facing_direction = 0;
+    } else if (absolute_value(dp.x) > absolute_value(dp.y)) {
+        if (dp.x > 0) {
+            high->facing_direction[entity.high_index] = 0;
         } else {
-            entity.high->facing_direction = 2;
+            high->facing_direction[entity.high_index] = 2;
         }
     } else {
-        if (entity.high->dp.y > 0) {
-            entity.high->facing_direction = 1;
+        if (dp.y > 0) {
+            high->facing_direction[entity.high_index] = 1;
         } else {
-            entity.high->facing_direction = 3;
+            high->facing_direction[entity.high_index] = 3;
         }
     }
 
-    WorldPosition new_p = map_to_chunk_space(game_state->world, game_state->camera_p, entity.high->p);
-    change_entity_location(&game_state->world_arena, game_state->world, entity.low_index, &entity.low->p, &new_p);
-    entity.low->p = new_p;
+    set_high_p(high, entity.high_index, p);
+    set_high_dp(high, entity.high_index, dp);
+
+    remove_from_collision_grid(game_state, entity.low_index, old_player_p);
+    insert_into_collision_grid(game_state, entity.low_index, p);
+
+    WorldPosition old_p = unpack_world_position(&entity.low->p);
+    WorldPosition new_p = map_to_chunk_space(game_state->world, game_state->camera_p, p);
+    change_entity_location(game_state, entity.low_index, &old_p, &new_p);
+    entity.low->p = pack_world_position(&new_p);
+
+    // set_camera only looks at chunks entering or leaving, so anything walking out is dropped here
+    if (!is_in_sim_region(&game_state->sim_region, new_p.chunk_x, new_p.chunk_y, new_p.chunk_z)) {
+        make_entity_low_freq(game_state, entity.low_index);
+    }
+}
+
+internal SimChunkRegion get_sim_region(World* world, WorldPosition camera_p) {
+    u32 tile_span_x = 17 * 3;
+    u32 tile_span_y = 9 * 3;
+    Rect2 camera_bounds = rect_center_dim(v2(0,0),
+                                          world->tile_side_in_meters * v2((f32)tile_span_x, (f32)tile_span_y));
+
+    WorldPosition min_chunk_p = map_to_chunk_space(world, camera_p, get_min_corner(camera_bounds));
+    WorldPosition max_chunk_p = map_to_chunk_space(world, camera_p, get_max_corner(camera_bounds));
+    SimChunkRegion result = {};
+    result.min_chunk_x = min_chunk_p.chunk_x;
+    result.min_chunk_y = min_chunk_p.chunk_y;
+    result.max_chunk_x = max_chunk_p.chunk_x + 1;
+    result.max_chunk_y = max_chunk_p.chunk_y + 1;
+    result.chunk_z = camera_p.chunk_z;
+    return result;
 }
 
+// Only chunks that enter or leave the region are touched, everything that stays in range
+// just gets shifted by the camera move.
 internal void set_camera(GameState *game_state, WorldPosition new_camera_p) {
     World* world = game_state->world;
     assert(validate_entity_pairs(game_state));
 
+    // every high position shifts below, the grid gets rebuilt at the start of the next frame
+    game_state->collision_grid.is_valid = false;
+
     WorldDifference d_camera_p = subtract(world, &new_camera_p, &game_state->camera_p);
     game_state->camera_p = new_camera_p;
 
-    u32 tile_span_x = 17 * 3;
-    u32 tile_span_y = 9 * 3;
-    Rect2 camera_bounds = rect_center_dim(v2(0,0),
-                                          world->tile_side_in_meters * v2((f32)tile_span_x, (f32)tile_span_y));
-
     V2 entity_offset_for_frame = -d_camera_p.d_xy;
-    offset_and_check_frequency_by_area(game_state, entity_offset_for_frame, camera_bounds);
-
-    // TODO chunkify
-    WorldPosition min_chunk_p = map_to_chunk_space(world, new_camera_p, get_min_corner(camera_bounds));
-    WorldPosition max_chunk_p = map_to_chunk_space(world, new_camera_p, get_max_corner(camera_bounds));
-    for (s32 chunk_y = min_chunk_p.chunk_y; chunk_y < max_chunk_p.chunk_y; ++chunk_y) {
-        for (s32 chunk_x = min_chunk_p.chunk_x; chunk_x < max_chunk_p.chunk_x; ++chunk_x) {
-            WorldChunk* chunk = get_world_chunk(world, chunk_x, chunk_y, new_camera_p.chunk_z);
-            if (!chunk) continue;
-
-            for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
-                for (u32 entity_index_index = 0; entity_index_index < block->entity_count; ++entity_index_index) {
-                    u32 low_entity_index = block->low_entity_index[entity_index_index];
-                    LowEntity* low = game_state->low_entities + low_entity_index;
-
-                    if (low->high_entity_index == NULL) {
-                        V2 camera_space_p = get_camera_space_p(game_state, low);
-                        if (is_in_rect(camera_bounds, camera_space_p)) {
-                            make_entity_high_freq(game_state, low, low_entity_index, camera_space_p);
-                        }
-                    }
-                }
+    offset_high_entities(game_state, entity_offset_for_frame);
+
+    SimChunkRegion new_region = get_sim_region(world, new_camera_p);
+
+    // new walls outside the old region stay low frequency until their chunk enters below
+    generate_world_chunks(game_state, &new_region);
+
+    SimChunkRegion old_region = game_state->sim_region;
+    for (s32 chunk_y = old_region.min_chunk_y; chunk_y < old_region.max_chunk_y; ++chunk_y) {
+        for (s32 chunk_x = old_region.min_chunk_x; chunk_x < old_region.max_chunk_x; ++chunk_x) {
+            if (!is_in_sim_region(&new_region, chunk_x, chunk_y, old_region.chunk_z)) {
+                set_chunk_frequency(game_state, chunk_x, chunk_y, old_region.chunk_z, false);
+            }
+        }
+    }
+
+    for (s32 chunk_y = new_region.min_chunk_y; chunk_y < new_region.max_chunk_y; ++chunk_y) {
+        for (s32 chunk_x = new_region.min_chunk_x; chunk_x < new_region.max_chunk_x; ++chunk_x) {
+            if (!is_in_sim_region(&old_region, chunk_x, chunk_y, new_region.chunk_z)) {
+                set_chunk_frequency(game_state, chunk_x, chunk_y, new_region.chunk_z, true);
             }
         }
     }
+
+    game_state->sim_region = new_region;
     assert(validate_entity_pairs(game_state));
+}
 
+internal bool is_near_sim_region(SimChunkRegion* region, s32 radius, s32 chunk_x, s32 chunk_y, s32 chunk_z) {
+    return chunk_z == region->chunk_z &&
+           chunk_x >= region->min_chunk_x - radius && chunk_x < region->max_chunk_x + radius &&
+           chunk_y >= region->min_chunk_y - radius && chunk_y < region->max_chunk_y + radius;
 }
 
-extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
-    assert(&input->controllers[0].terminator - &input->controllers[0].buttons[0] == array_count(input->controllers[0].buttons));
-    assert(sizeof(GameState) <= memory->permanent_storage_size);
+// Writes the chunk and its entities to the swap file and gives their memory back. Returns
+// false and leaves the chunk alone if it holds a hero or the write fails.
+internal bool page_out_world_chunk(GameState* game_state, WorldChunkSlot* slot, MemoryArena* scratch) {
+    World* world = game_state->world;
+    ChunkPager* pager = &game_state->chunk_pager;
+    WorldChunk* chunk = slot->chunk;
+    assert(chunk && chunk->generated);
+
+    u32 entity_count = 0;
+    for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
+        for (u32 i = 0; i < block->entity_count; ++i) {
+            LowEntity* low = get_low_entity(game_state, block->low_entity_index[i]);
+            if (low->type == ET_HERO) return false;
+            assert(!low->high_entity_index);
+        }
+        entity_count += block->entity_count;
+    }
 
-    GameState* game_state = (GameState*)memory->permanent_storage;
-    if (!memory->is_initialized) {
-        // reserve slot 0 as null entity
-        add_low_entity(game_state, ET_NULL, NULL);
-        game_state->high_entity_count = 1;
+    TemporaryMemory temp = begin_temporary_memory(scratch);
+    u64 record_size = sizeof(ChunkSwapHeader) + (u64)entity_count * sizeof(LowEntity);
+    ChunkSwapHeader* header = (ChunkSwapHeader*)push_size(scratch, (size_t)record_size, alignof(ChunkSwapHeader));
+    header->chunk = *chunk;
+    header->chunk.first_block.entity_count = 0;
+    header->chunk.first_block.next = 0;
+    header->chunk.next_free = 0;
+    header->entity_count = entity_count;
+    LowEntity* entities = (LowEntity*)(header + 1);
+    for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
+        for (u32 i = 0; i < block->entity_count; ++i) {
+            *entities++ = *get_low_entity(game_state, block->low_entity_index[i]);
+        }
+    }
 
-        game_state->backdrop =
-            debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_background.bmp");
-        game_state->shadow =
-            debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_shadow.bmp");
-        game_state->tree =
-            debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test2/tree00.bmp");
-
-        HeroBitmaps* bitmap = game_state->hero_bitmaps;
-
-        bitmap->head = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_right_head.bmp");
-        bitmap->cape = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_right_cape.bmp");
-        bitmap->torso = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_right_torso.bmp");
-        bitmap->align_x = 72;
-        bitmap->align_y = 182;
-        bitmap++;
-
-        bitmap->head = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_back_head.bmp");
-        bitmap->cape = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_back_cape.bmp");
-        bitmap->torso = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_back_torso.bmp");
-        bitmap->align_x = 72;
-        bitmap->align_y = 182;
-        bitmap++;
-
-        bitmap->head = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_left_head.bmp");
-        bitmap->cape = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_left_cape.bmp");
-        bitmap->torso = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_left_torso.bmp");
-        bitmap->align_x = 72;
-        bitmap->align_y = 182;
-        bitmap++;
-
-        bitmap->head = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_front_head.bmp");
-        bitmap->cape = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_front_cape.bmp");
-        bitmap->torso = debug_load_bmp(thread, memory->debug_platform_read_entire_file, "test/test_hero_front_torso.bmp");
-        bitmap->align_x = 72;
-        bitmap->align_y = 182;
+    // the chunk's last extent is reused if the record still fits
+    u64 offset = slot->swap_offset;
+    if (record_size > slot->swap_size) {
+        offset = pager->swap_file_size;
+        pager->swap_file_size += record_size;
+    }
+    bool written = platform_write_data_to_file(&pager->swap_file, offset, record_size, header);
+    end_temporary_memory(temp);
+    if (!written) return false;
 
-        initialize_arena(&game_state->world_arena, memory->permanent_storage_size - sizeof(GameState), (u8*)memory->permanent_storage + sizeof(GameState));
-        game_state->world = push_struct(&game_state->world_arena, World);
-        World* world = game_state->world;
-
-        initialize_world(world, 1.4f);
-
-        u32 tiles_per_width = 17;
-        u32 tiles_per_height = 9;
-        u32 screen_base_x = 0;
-        u32 screen_base_y = 0;
-        u32 screen_base_z = 0;
-        u32 screen_x = screen_base_x;
-        u32 screen_y = screen_base_y;
-        u32 abs_tile_z = screen_base_z;
-        bool door_right = false;
-        bool door_left = false;
-        bool door_top = false;
-        bool door_bottom = false;
-        bool door_up = false;
-        bool door_down = false;
-        for (u32 screen_index = 0; screen_index < 2000; ++screen_index) {
-            u32 random_choice;
-            // avoid up -> down -> up  or vice versa
-            // if (door_up || door_down) {
-            {
-                random_choice = rand() % 2;
+    for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
+        for (u32 i = 0; i < block->entity_count; ++i) {
+            free_low_entity(game_state, block->low_entity_index[i]);
+        }
+    }
+
+    slot->swap_offset = offset;
+    slot->swap_size = (u32)record_size;
+    slot->chunk = 0;
+    free_world_chunk(world, chunk);
+    --world->resident_chunk_count;
+    ++pager->paged_out_count;
+
+    return true;
+}
+
+// The entities come back with new low indices, nothing held on to the old ones.
+internal void page_in_world_chunk(GameState* game_state, WorldChunkSlot* slot, MemoryArena* scratch) {
+    World* world = game_state->world;
+    ChunkPager* pager = &game_state->chunk_pager;
+    assert(is_chunk_paged_out(slot));
+
+    TemporaryMemory temp = begin_temporary_memory(scratch);
+    ChunkSwapHeader* header = (ChunkSwapHeader*)push_size(scratch, slot->swap_size, alignof(ChunkSwapHeader));
+    bool read = platform_read_data_from_file(&pager->swap_file, slot->swap_offset, slot->swap_size, header);
+    assert(read);
+
+    WorldChunk* chunk = allocate_world_chunk(world, &game_state->world_arena);
+    if (read) {
+        *chunk = header->chunk;
+    } else {
+        // the walls are gone, but an empty chunk beats a hole in the world
+        *chunk = {};
+        chunk->chunk_x = slot->chunk_x;
+        chunk->chunk_y = slot->chunk_y;
+        chunk->chunk_z = slot->chunk_z;
+        chunk->generated = true;
+    }
+    chunk->first_block.entity_count = 0;
+    chunk->first_block.next = 0;
+    chunk->next_free = 0;
+    chunk->last_near_frame = game_state->frame_index;
+    slot->chunk = chunk;
+    ++world->resident_chunk_count;
+    ++pager->paged_in_count;
+
+    if (read) {
+        LowEntity* entities = (LowEntity*)(header + 1);
+        for (u32 i = 0; i < header->entity_count; ++i) {
+            WorldPosition p = unpack_world_position(&entities[i].p);
+            add_low_entity(game_state, (EntityType)entities[i].type, &p, entities[i].size_x, entities[i].size_y);
+        }
+    }
+
+    end_temporary_memory(temp);
+}
+
+// Runs after the camera has moved. The sim region only ever moves a fraction of a chunk a
+// frame, so reading ahead by a couple of chunks means set_camera never reaches a chunk on disk.
+internal void update_chunk_paging(GameState* game_state, MemoryArena* scratch) {
+    World* world = game_state->world;
+    ChunkPager* pager = &game_state->chunk_pager;
+    SimChunkRegion* region = &game_state->sim_region;
+    if (!pager->swap_file.no_errors) return;
+
+    s32 radius = CHUNK_READ_AHEAD_RADIUS;
+    for (s32 chunk_y = region->min_chunk_y - radius; chunk_y < region->max_chunk_y + radius; ++chunk_y) {
+        for (s32 chunk_x = region->min_chunk_x - radius; chunk_x < region->max_chunk_x + radius; ++chunk_x) {
+            u32 probe_count;
+            WorldChunkSlot* slot = find_chunk_slot(world->chunk_slots, world->chunk_slot_count,
+                                                   chunk_x, chunk_y, region->chunk_z, &probe_count);
+            if (is_chunk_paged_out(slot)) {
+                page_in_world_chunk(game_state, slot, scratch);
             }
-            // } else {
-            //     random_choice = rand() % 3;
-            // }
-            if (random_choice == 0) {
-                door_top = true;
-            } else if (random_choice == 1) {
-                door_right = true;
-            } else if (random_choice == 2) {
-                if (abs_tile_z == screen_base_z) {
-                    door_up = true;
-                } else {
-                    door_down = true;
-                }
+            if (slot->chunk) {
+                slot->chunk->last_near_frame = game_state->frame_index;
             }
-            for (u32 tile_y = 0; tile_y < tiles_per_height; ++tile_y) {
-                for (u32 tile_x = 0; tile_x < tiles_per_width; ++tile_x) {
-                    u32 abs_tile_x = screen_x * tiles_per_width + tile_x;
-                    u32 abs_tile_y = screen_y * tiles_per_height + tile_y;
+        }
+    }
 
-                    u32 tile_value = 1;
+    u32 mask = world->chunk_slot_count - 1;
+    for (u32 scan = 0; scan < CHUNK_PAGE_OUT_SCAN_COUNT; ++scan) {
+        pager->scan_slot_index = (pager->scan_slot_index + 1) & mask;
+        WorldChunkSlot* slot = world->chunk_slots + pager->scan_slot_index;
+        WorldChunk* chunk = slot->chunk;
+        if (chunk && chunk->generated &&
+            game_state->frame_index - chunk->last_near_frame >= CHUNK_PAGE_OUT_FRAMES &&
+            !is_near_sim_region(region, CHUNK_PAGE_OUT_RADIUS, chunk->chunk_x, chunk->chunk_y, chunk->chunk_z)) {
+            page_out_world_chunk(game_state, slot, scratch);
+        }
+    }
+}
 
-                    // left side
-                    if (tile_x == 0 && !(door_left && tile_y == tiles_per_height / 2)) {
-                        tile_value = 2;
-                    }
-                    // right side
-                    if ((tile_x == tiles_per_width - 1) && !(door_right && tile_y == tiles_per_height / 2)) {
-                        tile_value = 2;
-                    }
-                    // bottom side
-                    if (tile_y == 0 && !(door_bottom && tile_x == tiles_per_width / 2)) {
-                        tile_value = 2;
-                    }
-                    // top side
-                    if ((tile_y == tiles_per_height - 1) && !(door_top && tile_x == tiles_per_width / 2)) {
-                        tile_value = 2;
-                    }
+// A copy of the world arena with its pointers relative to from_base, which the walk moves to
+// to_base. The copy is walked through the pointers as they were, so it works in either
+// direction. A loaded snapshot can point anywhere, so a pointer to something that isn't inside
+// the image comes back null and marks the relocation failed instead of being followed.
+struct ArenaRelocation {
+    u8* image;
+    size_t size;
+    size_t from_base;
+    size_t to_base;
+    bool failed;
+};
 
-                    if (tile_x == 10 && tile_y == 6) {
-                        if (door_up) {
-                            tile_value = 3;
-                        } else if (door_down) {
-                            tile_value = 4;
-                        }
-                    }
+internal bool is_in_relocation(ArenaRelocation* relocation, void* pointer, size_t size) {
+    size_t offset = (size_t)pointer - relocation->from_base;
+    bool result = ((size_t)pointer >= relocation->from_base &&
+                   size <= relocation->size && offset <= relocation->size - size);
+    if (!result) {
+        relocation->failed = true;
+    }
+    return result;
+}
+
+internal void* get_image_pointer(ArenaRelocation* relocation, void* pointer, size_t size) {
+    void* result = 0;
+    if (pointer && is_in_relocation(relocation, pointer, size)) {
+        result = relocation->image + ((size_t)pointer - relocation->from_base);
+    }
+    return result;
+}
+
+internal void* get_relocated_pointer(ArenaRelocation* relocation, void* pointer, size_t size) {
+    void* result = 0;
+    if (pointer && is_in_relocation(relocation, pointer, size)) {
+        result = (void*)((size_t)pointer - relocation->from_base + relocation->to_base);
+    }
+    return result;
+}
+
+#define get_image_struct(relocation, pointer, type) (type*)get_image_pointer(relocation, pointer, sizeof(type))
+#define relocate_pointer(relocation, pointer, type) ((pointer) = (type*)get_relocated_pointer(relocation, pointer, sizeof(type)))
+
+internal void relocate_entity_blocks(ArenaRelocation* relocation, WorldEntityBlock** link) {
+    while (*link) {
+        WorldEntityBlock* block = get_image_struct(relocation, *link, WorldEntityBlock);
+        relocate_pointer(relocation, *link, WorldEntityBlock);
+        if (!block) break;
+        link = &block->next;
+    }
+}
 
-                    if (tile_value == 2) {
-                        add_wall(game_state, abs_tile_x, abs_tile_y, abs_tile_z);
+// Only what can still be reached is moved. Generated chunks have let go of their rooms and a
+// room that has emitted its walls never looks at its chunks again, so both are left as they are.
+internal void relocate_world_arena(ArenaRelocation* relocation) {
+    // the world is the first thing in its arena
+    World* world = (World*)relocation->image;
+
+    relocate_entity_blocks(relocation, &world->first_free);
+
+    WorldChunk** chunk_link = &world->first_free_chunk;
+    while (*chunk_link) {
+        WorldChunk* chunk = get_image_struct(relocation, *chunk_link, WorldChunk);
+        relocate_pointer(relocation, *chunk_link, WorldChunk);
+        if (!chunk) break;
+        chunk_link = &chunk->next_free;
+    }
+
+    // probing masks with the slot count, so it has to be a power of two with a free slot
+    WorldChunkSlot* slots = (WorldChunkSlot*)get_image_pointer(relocation, world->chunk_slots,
+                                                                (size_t)world->chunk_slot_count * sizeof(WorldChunkSlot));
+    if (!slots || (world->chunk_slot_count & (world->chunk_slot_count - 1)) ||
+        world->chunk_count >= world->chunk_slot_count) {
+        relocation->failed = true;
+        return;
+    }
+    relocate_pointer(relocation, world->chunk_slots, WorldChunkSlot);
+    for (u32 slot_index = 0; slot_index < world->chunk_slot_count; ++slot_index) {
+        WorldChunkSlot* slot = slots + slot_index;
+        WorldChunk* old_chunk = slot->chunk;
+        WorldChunk* chunk = get_image_struct(relocation, old_chunk, WorldChunk);
+        if (!chunk) continue;
+        relocate_pointer(relocation, slot->chunk, WorldChunk);
+
+        relocate_entity_blocks(relocation, &chunk->first_block.next);
+        if (chunk->room_count > array_count(chunk->rooms)) {
+            relocation->failed = true;
+            return;
+        }
+        for (u32 room_index = 0; room_index < chunk->room_count; ++room_index) {
+            WorldRoom* room = get_image_struct(relocation, chunk->rooms[room_index], WorldRoom);
+            relocate_pointer(relocation, chunk->rooms[room_index], WorldRoom);
+            if (!room) continue;
+
+            // every chunk the room overlaps lists it, only the first one moves its pointers
+            if (!room->walls_emitted && room->chunks[0][0] == old_chunk) {
+                for (u32 y = 0; y < ROOM_CHUNK_SPAN_Y; ++y) {
+                    for (u32 x = 0; x < ROOM_CHUNK_SPAN_X; ++x) {
+                        relocate_pointer(relocation, room->chunks[y][x], WorldChunk);
                     }
                 }
             }
-            if (random_choice == 0) {
-                screen_y += 1;
-            } else if (random_choice == 1) {
-                screen_x += 1;
-            } else if (random_choice == 2) {
-                if (abs_tile_z == screen_base_z) {
-                    abs_tile_z = screen_base_z + 1;
-                } else {
-                    abs_tile_z = screen_base_z;
-                }
-            }
-            door_left = door_right;
-            door_bottom = door_top;
-            door_top = false;
-            door_right = false;
-            if (random_choice == 2) {
-                door_up = !door_up;
-                door_down = !door_down;
-            } else {
-                door_down = false;
-                door_up = false;
+        }
+    }
+}
+
+// Everything goes into one image in the scratch arena and out in a single write. Paged out
+// chunks go in as the swap file's bytes, so they don't have to be read back in first.
+internal bool write_world_snapshot(GameState* game_state, MemoryArena* scratch,
+                                   platform_write_entire_file_func* write_entire_file, char* filename) {
+    ChunkPager* pager = &game_state->chunk_pager;
+    MemoryArena* world_arena = &game_state->world_arena;
+    assert((u8*)game_state->world == world_arena->base);
+
+    HHSHeader header = {};
+    header.magic_value = HHS_MAGIC_VALUE;
+    header.version = HHS_VERSION;
+    header.game_state_size = sizeof(GameStateSnapshot);
+    header.low_entity_page_size = sizeof(LowEntityPage);
+    header.world_chunk_size = sizeof(WorldChunk);
+    header.low_entity_count = game_state->low_entity_count;
+    header.low_entity_page_count = game_state->low_entity_page_count;
+    header.game_state = sizeof(HHSHeader);
+    header.low_entity_pages = header.game_state + sizeof(GameStateSnapshot);
+    header.world_arena = header.low_entity_pages + (u64)header.low_entity_page_count * sizeof(u64);
+    header.world_arena_size = world_arena->used;
+    header.swap = header.world_arena + header.world_arena_size;
+    header.swap_size = pager->swap_file_size;
+    u64 size = header.swap + header.swap_size;
+
+    TemporaryMemory temp = begin_temporary_memory(scratch);
+    u8* image = (u8*)push_size(scratch, (size_t)size, 16);
+    *(HHSHeader*)image = header;
+
+    GameStateSnapshot* snapshot = (GameStateSnapshot*)(image + header.game_state);
+    *snapshot = {};
+    snapshot->camera_following_entity_ref = game_state->camera_following_entity_ref;
+    snapshot->camera_p = game_state->camera_p;
+    snapshot->world_generator = game_state->world_generator;
+    snapshot->world_generator.queue = 0;
+    for (u32 i = 0; i < array_count(snapshot->player_ref_for_controller); ++i) {
+        snapshot->player_ref_for_controller[i] = game_state->player_ref_for_controller[i];
+    }
+    snapshot->frame_index = game_state->frame_index;
+    snapshot->free_low_entity_count = game_state->free_low_entity_count;
+    snapshot->first_free_low_entity_index = game_state->first_free_low_entity_index;
+
+    ArenaRelocation relocation = {};
+    relocation.image = image + header.world_arena;
+    relocation.size = world_arena->used;
+    relocation.from_base = (size_t)world_arena->base;
+    relocation.to_base = (size_t)header.world_arena;
+
+    copy_memory(world_arena->used, world_arena->base, relocation.image);
+    relocate_world_arena(&relocation);
+
+    // the pages came along with the world arena, only what points into it has to change
+    u64* page_offsets = (u64*)(image + header.low_entity_pages);
+    for (u32 page_index = 0; page_index < header.low_entity_page_count; ++page_index) {
+        page_offsets[page_index] = (u64)get_relocated_pointer(&relocation, game_state->low_entity_pages[page_index],
+                                                              sizeof(LowEntityPage));
+    }
+    for (u32 i = 0; i < header.low_entity_count; ++i) {
+        LowEntityPage* page = get_image_struct(&relocation, get_low_entity_page(game_state, i), LowEntityPage);
+        u32 slot = i & LOW_ENTITY_PAGE_MASK;
+        page->hot[slot].high_entity_index = 0;
+        relocate_pointer(&relocation, page->cold[slot].block, WorldEntityBlock);
+    }
+    // the live world only points into itself
+    assert(!relocation.failed);
+
+    bool result = true;
+    if (header.swap_size) {
+        result = platform_read_data_from_file(&pager->swap_file, 0, header.swap_size, image + header.swap);
+    }
+    if (result) {
+        result = write_entire_file(filename, size, image);
+    }
+
+    end_temporary_memory(temp);
+    return result;
+}
+
+// Leaves the game state alone and returns false if the snapshot can't be used. The sim region
+// is left empty, set_camera brings the entities around the camera back in.
+internal bool load_world_snapshot(GameState* game_state, GameMemory* memory, char* filename) {
+    PlatformMappedFile file = memory->platform_map_file(filename);
+    if (!file.contents) {
+        return false;
+    }
+
+    ChunkPager* pager = &game_state->chunk_pager;
+    MemoryArena* world_arena = &game_state->world_arena;
+    HHSHeader* header = (HHSHeader*)file.contents;
+    u8* contents = (u8*)file.contents;
+
+    bool valid = (file.size >= sizeof(HHSHeader) &&
+                  header->magic_value == HHS_MAGIC_VALUE &&
+                  header->version == HHS_VERSION &&
+                  header->game_state_size == sizeof(GameStateSnapshot) &&
+                  header->low_entity_page_size == sizeof(LowEntityPage) &&
+                  header->world_chunk_size == sizeof(WorldChunk) &&
+                  header->low_entity_count > 0 &&
+                  header->low_entity_page_count == (header->low_entity_count + LOW_ENTITY_PAGE_MASK) >> LOW_ENTITY_PAGE_SHIFT &&
+                  header->low_entity_page_count <= MAX_LOW_ENTITY_PAGE_COUNT &&
+                  header->game_state + sizeof(GameStateSnapshot) <= file.size &&
+                  header->low_entity_pages + (u64)header->low_entity_page_count * sizeof(u64) <= file.size &&
+                  header->world_arena_size >= sizeof(World) &&
+                  header->world_arena_size <= world_arena->size &&
+                  header->world_arena + header->world_arena_size <= file.size &&
+                  header->swap + header->swap_size <= file.size);
+
+    u64* page_offsets = (u64*)(contents + header->low_entity_pages);
+    for (u32 page_index = 0; valid && page_index < header->low_entity_page_count; ++page_index) {
+        valid = (page_offsets[page_index] >= header->world_arena &&
+                 page_offsets[page_index] + sizeof(LowEntityPage) <= header->world_arena + header->world_arena_size);
+    }
+
+    // the paged out chunks have to make it into this process's swap file before anything changes
+    if (valid && header->swap_size) {
+        valid = pager->swap_file.no_errors &&
+                platform_write_data_to_file(&pager->swap_file, 0, header->swap_size, contents + header->swap);
+    }
+
+    if (valid) {
+        assert(world_arena->used == 0);
+        u8* world_image = (u8*)push_size(world_arena, (size_t)header->world_arena_size, 1);
+        copy_memory((size_t)header->world_arena_size, contents + header->world_arena, world_image);
+
+        ArenaRelocation relocation = {};
+        relocation.image = world_arena->base;
+        relocation.size = world_arena->used;
+        relocation.from_base = (size_t)header->world_arena;
+        relocation.to_base = (size_t)world_arena->base;
+        relocate_world_arena(&relocation);
+        game_state->world = (World*)world_arena->base;
+
+        game_state->low_entity_count = header->low_entity_count;
+        game_state->low_entity_page_count = header->low_entity_page_count;
+        for (u32 page_index = 0; page_index < header->low_entity_page_count; ++page_index) {
+            game_state->low_entity_pages[page_index] =
+                (LowEntityPage*)get_relocated_pointer(&relocation, (void*)page_offsets[page_index], sizeof(LowEntityPage));
+        }
+        for (u32 i = 0; i < header->low_entity_count; ++i) {
+            LowEntityPage* page = get_low_entity_page(game_state, i);
+            relocate_pointer(&relocation, page->cold[i & LOW_ENTITY_PAGE_MASK].block, WorldEntityBlock);
+        }
+
+        // the world goes back the way it was found and the game generates a new one
+        valid = !relocation.failed;
+        if (!valid) {
+            world_arena->used = 0;
+            game_state->world = 0;
+            game_state->low_entity_count = 0;
+            game_state->low_entity_page_count = 0;
+        }
+    }
+
+    if (valid) {
+        GameStateSnapshot* snapshot = (GameStateSnapshot*)(contents + header->game_state);
+        game_state->camera_following_entity_ref = snapshot->camera_following_entity_ref;
+        game_state->camera_p = snapshot->camera_p;
+        game_state->sim_region = {};
+        game_state->world_generator = snapshot->world_generator;
+        game_state->world_generator.queue = memory->high_priority_queue;
+        for (u32 i = 0; i < array_count(snapshot->player_ref_for_controller); ++i) {
+            game_state->player_ref_for_controller[i] = snapshot->player_ref_for_controller[i];
+        }
+        game_state->frame_index = snapshot->frame_index;
+        game_state->free_low_entity_count = snapshot->free_low_entity_count;
+        game_state->first_free_low_entity_index = snapshot->first_free_low_entity_index;
+        pager->swap_file_size = header->swap_size;
+    }
+
+    memory->platform_unmap_file(&file);
+    return valid;
+}
+
+#if HANDMADE_SLOW
+internal bool validate_chunk_refs(GameState* game_state) {
+    World* world = game_state->world;
+    u32 referenced_count = 0;
+    for (u32 slot_index = 0; slot_index < world->chunk_slot_count; ++slot_index) {
+        WorldChunk* chunk = world->chunk_slots[slot_index].chunk;
+        if (!chunk) continue;
+
+        for (WorldEntityBlock* block = &chunk->first_block; block; block = block->next) {
+            for (u32 i = 0; i < block->entity_count; ++i) {
+                LowEntity* low = get_low_entity(game_state, block->low_entity_index[i]);
+                LowEntityCold* cold = get_low_entity_cold(game_state, block->low_entity_index[i]);
+                if (!low || cold->block != block || cold->index_in_block != i) return false;
+                if (low->p.chunk_x != chunk->chunk_x || low->p.chunk_y != chunk->chunk_y ||
+                    low->p.chunk_z != chunk->chunk_z) return false;
+                ++referenced_count;
             }
         }
+    }
+
+    // every entity but the null one and the freed ones has a position
+    return referenced_count == game_state->low_entity_count - 1 - game_state->free_low_entity_count;
+}
+#endif
+
+extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
+    assert(&input->controllers[0].terminator - &input->controllers[0].buttons[0] == array_count(input->controllers[0].buttons));
+    assert(sizeof(GameState) <= memory->permanent_storage_size);
+
+    platform_add_entry = memory->platform_add_entry;
+    platform_complete_all_work = memory->platform_complete_all_work;
+    platform_read_data_from_file = memory->platform_read_data_from_file;
+    platform_write_data_to_file = memory->platform_write_data_to_file;
+
+    GameState* game_state = (GameState*)memory->permanent_storage;
+    if (!memory->is_initialized) {
+        game_state->high_entity_count = 1;
+        initialize_arena(&game_state->world_arena, memory->permanent_storage_size - sizeof(GameState), (u8*)memory->permanent_storage + sizeof(GameState));
+#if HANDMADE_INTERNAL
+        attach_arena_telemetry(&game_state->world_arena, &game_state->world_arena_telemetry, "world");
+#endif
+        game_state->chunk_pager.swap_file = memory->platform_open_swap_file("handmade.swap");
 
         WorldPosition new_camera_p = {};
-        new_camera_p = chunk_position_from_tile_position(world, screen_base_x*tiles_per_width + 17/2,
-                                                         screen_base_y*tiles_per_height + 9/2,
-                                                         screen_base_z);
+        if (memory->snapshot_filename && load_world_snapshot(game_state, memory, memory->snapshot_filename)) {
+            new_camera_p = game_state->camera_p;
+        } else {
+            game_state->world = push_struct(&game_state->world_arena, World);
+            World* world = game_state->world;
+
+            initialize_world(world, &game_state->world_arena, 1.4f);
+
+            // reserve slot 0 as null entity, its page goes on the arena after the world
+            add_low_entity(game_state, ET_NULL, NULL);
+
+            u32 screen_base_x = 0;
+            u32 screen_base_y = 0;
+            u32 screen_base_z = 0;
+            initialize_world_generator(&game_state->world_generator, memory->high_priority_queue, 2000, 1234);
+
+            new_camera_p = chunk_position_from_tile_position(world, screen_base_x*ROOM_TILE_COUNT_X + 17/2,
+                                                             screen_base_y*ROOM_TILE_COUNT_Y + 9/2,
+                                                             screen_base_z);
+        }
+        initialize_entity_templates(game_state);
         set_camera(game_state, new_camera_p);
+#if HANDMADE_SLOW
+        assert(validate_chunk_refs(game_state));
+#endif
 
         memory->is_initialized = true;
     }
 
+    assert(sizeof(TransientState) <= memory->transient_storage_size);
+    TransientState* transient_state = (TransientState*)memory->transient_storage;
+    if (!transient_state->is_initialized) {
+        initialize_arena(&transient_state->tran_arena, memory->transient_storage_size - sizeof(TransientState),
+                         (u8*)memory->transient_storage + sizeof(TransientState));
+#if HANDMADE_INTERNAL
+        attach_arena_telemetry(&transient_state->tran_arena, &transient_state->tran_arena_telemetry, "transient");
+#endif
+        transient_state->render_group = allocate_render_group(&transient_state->tran_arena, (u32)megabytes(4));
+        transient_state->assets = allocate_game_assets(&transient_state->tran_arena, megabytes(64), memory->low_priority_queue,
+                                                       memory->platform_map_file, "test.hha");
+        sub_arena(&transient_state->frame_arena, &transient_state->tran_arena, megabytes(16));
+#if HANDMADE_INTERNAL
+        attach_arena_telemetry(&transient_state->frame_arena, &transient_state->frame_arena_telemetry, "frame");
+#endif
+        transient_state->is_initialized = true;
+    }
+
+    RenderGroup* render_group = transient_state->render_group;
+    Assets* assets = transient_state->assets;
+    begin_asset_frame(assets);
+    clear_render_group(render_group);
+    clear_arena(&transient_state->frame_arena);
+#if HANDMADE_INTERNAL
+    begin_arena_telemetry_frame(&game_state->world_arena_telemetry);
+    begin_arena_telemetry_frame(&transient_state->tran_arena_telemetry);
+    begin_arena_telemetry_frame(&transient_state->frame_arena_telemetry);
+#endif
+
     World* world = game_state->world;
 
     s32 tile_side_in_pixels = 60;
@@ -687,13 +1570,15 @@ extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
     f32 lower_left_x = -((f32)tile_side_in_pixels / 2);
     f32 lower_left_y = (f32)buffer->height;
 
+    rebuild_collision_grid(game_state);
+
     for (int i = 0; i < array_count(input->controllers); i++) {
         GameControllerInput* controller = get_controller(input, i);
-        u32 low_index = game_state->player_index_for_controller[i];
+        u32 low_index = get_low_entity_index(game_state, game_state->player_ref_for_controller[i]);
         if (low_index == 0) {
             if (controller->start.ended_down) {
                 u32 entity_index = add_player(game_state);
-                game_state->player_index_for_controller[i] = entity_index;
+                game_state->player_ref_for_controller[i] = get_low_entity_reference(game_state, entity_index);
             }
         } else {
             Entity controlling_entity = get_high_entity(game_state, low_index);
@@ -716,39 +1601,49 @@ extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
                 }
             }
             if (controller->action_up.ended_down) {
-                controlling_entity.high->dz = 3.0f;
+                game_state->high_entities.dz[controlling_entity.high_index] = 3.0f;
             }
             move_player(game_state, controlling_entity, input->dt_for_frame, ddp);
         }
     }
 
-    V2 entity_offset_for_frame = {};
-    Entity camera_following_entity = get_high_entity(game_state, game_state->camera_following_entity_index);
-    if (camera_following_entity.high) {
+    Entity camera_following_entity = get_high_entity(game_state, get_low_entity_index(game_state, game_state->camera_following_entity_ref));
+    if (camera_following_entity.high_index) {
         WorldPosition new_camera_p = game_state->camera_p;
         new_camera_p.chunk_z = camera_following_entity.low->p.chunk_z;
 #if 0
-        if (camera_following_entity.high->p.x > (9.0f * world->tile_side_in_meters)) {
+        if (game_state->high_entities.p_x[camera_following_entity.high_index] > (9.0f * world->tile_side_in_meters)) {
             new_camera_p.abs_tile_x += 17;
-        } else if (camera_following_entity.high->p.x < -(9.0f * world->tile_side_in_meters)) {
+        } else if (game_state->high_entities.p_x[camera_following_entity.high_index] < -(9.0f * world->tile_side_in_meters)) {
             new_camera_p.abs_tile_x -= 17;
         }
-        if (camera_following_entity.high->p.y > (5.0f * world->tile_side_in_meters)) {
+        if (game_state->high_entities.p_y[camera_following_entity.high_index] > (5.0f * world->tile_side_in_meters)) {
             new_camera_p.abs_tile_y += 9;
-        } else if (camera_following_entity.high->p.y < -(5.0f * world->tile_side_in_meters)) {
+        } else if (game_state->high_entities.p_y[camera_following_entity.high_index] < -(5.0f * world->tile_side_in_meters)) {
             new_camera_p.abs_tile_y -= 9;
         }
 #else
-        new_camera_p = camera_following_entity.low->p;
+        new_camera_p = unpack_world_position(&camera_following_entity.low->p);
 #endif
 
         set_camera(game_state, new_camera_p);
     }
 
+    ++game_state->frame_index;
+    update_chunk_paging(game_state, &transient_state->frame_arena);
+
+    if (memory->snapshot_requested) {
+        memory->snapshot_requested = false;
+        if (memory->snapshot_filename) {
+            write_world_snapshot(game_state, &transient_state->tran_arena, memory->platform_write_entire_file,
+                                 memory->snapshot_filename);
+        }
+    }
+
 #if 1
-    draw_rectangle(buffer, v2(0.0f,0.0f), v2((f32)buffer->width, (f32)buffer->height), 0.5f, 0.5f, 0.5f);
+    push_clear(render_group, 0.5f, 0.5f, 0.5f);
 #else
-    draw_bitmap(buffer, &game_state->backdrop, 0, 0);
+    push_bitmap(render_group, get_bitmap(assets, ABI_BACKDROP), 0, 0);
 #endif
 
     f32 screen_center_x = 0.5f * (f32)buffer->width;
@@ -781,26 +1676,19 @@ extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
                 };
                 V2 min = cen - 0.9f * tile_side;
                 V2 max = cen + 0.9f * tile_side;
-                draw_rectangle(buffer, min, max, gray, gray, gray);
+                push_rectangle(render_group, min, max, gray, gray, gray);
             }
         }
     }
 #endif
 
-    for (u32 high_entity_index = 1; high_entity_index < game_state->high_entity_count; ++high_entity_index) {
-        HighEntity* high_entity = game_state->high_entities_ + high_entity_index;
-        LowEntity* low_entity = game_state->low_entities + high_entity->low_entity_index;
+    HighEntities* high = &game_state->high_entities;
+    integrate_high_entity_z(high, game_state->high_entity_count, input->dt_for_frame);
 
-        high_entity->p += entity_offset_for_frame;
+    for (u32 high_entity_index = 1; high_entity_index < game_state->high_entity_count; ++high_entity_index) {
+        LowEntity* low_entity = get_low_entity(game_state, high->low_entity_index[high_entity_index]);
 
-        f32 dt = input->dt_for_frame;
-        f32 ddz = -9.8f;
-        high_entity->z = (0.5f * ddz * square(dt)) + (high_entity->dz * dt) + high_entity->z;
-        high_entity->dz = (ddz * dt) + high_entity->dz;
-        if (high_entity->z < 0) {
-            high_entity->z = 0;
-        }
-        f32 c_alpha = 1.0f - (0.5f * high_entity->z);
+        f32 c_alpha = 1.0f - (0.5f * high->z[high_entity_index]);
         if (c_alpha < 0) {
             c_alpha = 0;
         }
@@ -808,30 +1696,113 @@ extern "C" GAME_UPDATE_AND_RENDER(game_update_and_render) {
         f32 player_r = 1.0f;
         f32 player_g = 1.0f;
         f32 player_b = 0.0f;
-        f32 player_ground_point_x = screen_center_x + meters_to_pixels * high_entity->p.x;
-        f32 player_ground_point_y = screen_center_y - meters_to_pixels * high_entity->p.y;
-        f32 z = -meters_to_pixels * high_entity->z;
+        f32 player_ground_point_x = screen_center_x + meters_to_pixels * high->p_x[high_entity_index];
+        f32 player_ground_point_y = screen_center_y - meters_to_pixels * high->p_y[high_entity_index];
+        f32 z = -meters_to_pixels * high->z[high_entity_index];
+        V2 entity_dim = get_entity_dim(game_state, low_entity);
         V2 player_left_top = {
-            player_ground_point_x - (0.5f * meters_to_pixels * low_entity->width),
-            player_ground_point_y - (0.5f * meters_to_pixels * low_entity->height)
+            player_ground_point_x - (0.5f * meters_to_pixels * entity_dim.x),
+            player_ground_point_y - (0.5f * meters_to_pixels * entity_dim.y)
         };
         V2 entity_width_height = {
-            meters_to_pixels * low_entity->width,
-            meters_to_pixels * low_entity->height
+            meters_to_pixels * entity_dim.x,
+            meters_to_pixels * entity_dim.y
         };
 
         if (low_entity->type == ET_HERO) {
-            HeroBitmaps* hero_bitmaps = &game_state->hero_bitmaps[high_entity->facing_direction];
-            draw_bitmap(buffer, &game_state->shadow, player_ground_point_x, player_ground_point_y, hero_bitmaps->align_x, hero_bitmaps->align_y, c_alpha);
-            draw_bitmap(buffer, &hero_bitmaps->torso, player_ground_point_x, player_ground_point_y + z, hero_bitmaps->align_x, hero_bitmaps->align_y);
-            draw_bitmap(buffer, &hero_bitmaps->cape, player_ground_point_x, player_ground_point_y + z, hero_bitmaps->align_x, hero_bitmaps->align_y);
-            draw_bitmap(buffer, &hero_bitmaps->head, player_ground_point_x, player_ground_point_y + z, hero_bitmaps->align_x, hero_bitmaps->align_y);
+            u32 facing = high->facing_direction[high_entity_index];
+            push_bitmap(render_group, get_bitmap(assets, ABI_SHADOW), player_ground_point_x, player_ground_point_y, c_alpha);
+            push_bitmap(render_group, get_bitmap(assets, (AssetBitmapId)(ABI_HERO_TORSO_RIGHT + facing)), player_ground_point_x, player_ground_point_y + z);
+            push_bitmap(render_group, get_bitmap(assets, (AssetBitmapId)(ABI_HERO_CAPE_RIGHT + facing)), player_ground_point_x, player_ground_point_y + z);
+            push_bitmap(render_group, get_bitmap(assets, (AssetBitmapId)(ABI_HERO_HEAD_RIGHT + facing)), player_ground_point_x, player_ground_point_y + z);
         } else {
-            draw_bitmap(buffer, &game_state->tree, player_ground_point_x, player_ground_point_y + z, 40, 80);
+            // merged walls still draw a tree per tile
+            f32 tile_side_in_pixels = meters_to_pixels * world->tile_side_in_meters;
+            s32 tile_count_x = low_entity->size_x;
+            s32 tile_count_y = low_entity->size_y;
+            LoadedBitmap* tree = get_bitmap(assets, ABI_TREE);
+            for (s32 tile_y = 0; tile_y < tile_count_y; ++tile_y) {
+                for (s32 tile_x = 0; tile_x < tile_count_x; ++tile_x) {
+                    f32 tile_ground_point_x = player_ground_point_x + tile_side_in_pixels * (tile_x - 0.5f * (tile_count_x - 1));
+                    f32 tile_ground_point_y = player_ground_point_y - tile_side_in_pixels * (tile_y - 0.5f * (tile_count_y - 1));
+                    push_bitmap(render_group, tree, tile_ground_point_x, tile_ground_point_y + z);
+                }
+            }
         }
     }
+
+    tiled_render_group_to_output(memory->high_priority_queue, render_group, buffer);
+
+    check_arena(&game_state->world_arena);
+    check_arena(&transient_state->tran_arena);
+    check_arena(&transient_state->frame_arena);
 }
 
+#if HANDMADE_INTERNAL
+internal void add_memory_stats(DebugMemoryStats* stats, MemoryArena* arena) {
+    ArenaTelemetry* telemetry = arena->telemetry;
+    if (!telemetry || stats->arena_count == array_count(stats->arenas)) return;
+
+    DebugArenaStats* dest = stats->arenas + stats->arena_count++;
+    dest->name = telemetry->name;
+    dest->size = arena->size;
+    dest->used = arena->used;
+    dest->peak_used = telemetry->peak_used;
+    dest->push_count = telemetry->push_count;
+    dest->pushed_size = telemetry->pushed_size;
+    dest->frame_push_count = telemetry->last_frame_push_count;
+    dest->frame_pushed_size = telemetry->last_frame_pushed_size;
+
+    // insertion into the list kept biggest first, whatever falls off the end is dropped
+    for (u32 site_index = 0; site_index < array_count(telemetry->call_sites); ++site_index) {
+        ArenaCallSite* site = telemetry->call_sites + site_index;
+        if (!site->push_count) continue;
+
+        u32 insert_index = stats->call_site_count;
+        while (insert_index > 0 && stats->call_sites[insert_index - 1].pushed_size < site->pushed_size) {
+            --insert_index;
+        }
+        if (insert_index == array_count(stats->call_sites)) continue;
+
+        u32 last = min(stats->call_site_count, (u32)array_count(stats->call_sites) - 1);
+        for (u32 i = last; i > insert_index; --i) {
+            stats->call_sites[i] = stats->call_sites[i - 1];
+        }
+        DebugArenaCallSite* call_site = stats->call_sites + insert_index;
+        call_site->arena_name = telemetry->name;
+        call_site->location = site->location;
+        call_site->push_count = site->push_count;
+        call_site->pushed_size = site->pushed_size;
+        if (stats->call_site_count < array_count(stats->call_sites)) {
+            ++stats->call_site_count;
+        }
+    }
+}
+
+extern "C" DEBUG_GAME_GET_MEMORY_STATS(debug_game_get_memory_stats) {
+    *stats = {};
+    GameState* game_state = (GameState*)memory->permanent_storage;
+    TransientState* transient_state = (TransientState*)memory->transient_storage;
+    if (!memory->is_initialized || !transient_state->is_initialized) return;
+
+    add_memory_stats(stats, &game_state->world_arena);
+    add_memory_stats(stats, &transient_state->tran_arena);
+    add_memory_stats(stats, &transient_state->frame_arena);
+
+    stats->permanent_storage_peak = sizeof(GameState) + game_state->world_arena_telemetry.peak_used;
+    stats->transient_storage_peak = sizeof(TransientState) + transient_state->tran_arena_telemetry.peak_used;
+
+    WorldChunkHashStats hash_stats = get_world_chunk_hash_stats(game_state->world);
+    stats->chunk_count = hash_stats.chunk_count;
+    stats->chunk_slot_count = hash_stats.slot_count;
+    stats->chunk_load_factor = hash_stats.load_factor;
+    stats->chunk_average_probe_length = hash_stats.average_probe_length;
+    stats->chunk_max_probe_length = hash_stats.max_probe_length;
+    stats->chunk_lookup_count = hash_stats.lookup_count;
+    stats->chunk_lookup_probe_count = hash_stats.lookup_probe_count;
+}
+#endif
+
 extern "C" GAME_GET_SOUND_SAMPLES(game_get_sound_samples) {
     GameState* game_state = (GameState*)memory->permanent_storage;
     game_output_sound(game_state, sound_buffer, 400);
@@ -2,104 +2,561 @@
 
 #include "handmade_platform.h"
 #include "handmade_math.h"
+#include "handmade_random.h"
 #include "handmade_world.h"
+#include "handmade_render_group.h"
+#include "handmade_asset.h"
 
 #define min(a, b) ((a < b) ? (a) : (b))
 #define max(a, b) ((a > b) ? (a) : (b))
 
+#if HANDMADE_INTERNAL
+#define ARENA_STRINGIFY_(value) #value
+#define ARENA_STRINGIFY(value) ARENA_STRINGIFY_(value)
+#define ARENA_CALL_SITE (char*)(__FILE__ "(" ARENA_STRINGIFY(__LINE__) ")")
+
+// Call sites are keyed by their text rather than the literal's address, the table lives in
+// game memory and has to survive a code reload.
+struct ArenaCallSite {
+    u32 hash;
+    char location[48];
+    u64 push_count;
+    u64 pushed_size;
+};
+
+// power of two, open addressing
+#define MAX_ARENA_CALL_SITES 128
+
+// Pushed sizes include the alignment padding. A sub arena shows up as one push in its parent.
+struct ArenaTelemetry {
+    char name[16];
+    size_t peak_used;
+    u64 push_count;
+    u64 pushed_size;
+
+    u32 frame_push_count;
+    u64 frame_pushed_size;
+    u32 last_frame_push_count;
+    u64 last_frame_pushed_size;
+
+    u32 call_site_count;
+    ArenaCallSite call_sites[MAX_ARENA_CALL_SITES];
+};
+#else
+#define ARENA_CALL_SITE (char*)0
+#endif
+
 struct MemoryArena {
     size_t size;
     u8* base;
     size_t used;
-};
 
-struct LoadedBitmap {
-    s32 width;
-    s32 height;
-    u32* pixels;
+    // open temporary memory scopes, nothing may reset the arena under one
+    u32 temp_count;
+
+#if HANDMADE_INTERNAL
+    // optional, pushes are only recorded once one is attached
+    ArenaTelemetry* telemetry;
+#endif
 };
 
-struct HeroBitmaps {
-    s32 align_x;
-    s32 align_y;
-    LoadedBitmap head;
-    LoadedBitmap cape;
-    LoadedBitmap torso;
+// Everything pushed between begin and end goes away at the end. Scopes nest and have to end in
+// the reverse of the order they began in.
+struct TemporaryMemory {
+    MemoryArena* arena;
+    size_t used;
 };
 
 enum EntityType {
     ET_NULL,
     ET_HERO,
     ET_WALL,
+
+    ET_COUNT,
 };
 
-struct HighEntity {
-    V2 p; // relative to camera
-    V2 dp;
-    u32 facing_direction;
-    u32 chunk_z;
+#define MAX_HIGH_ENTITY_COUNT 16384
 
-    f32 z;
-    f32 dz;
+// One array per field, indexed by high entity index, so the per frame passes sweep them a
+// vector at a time. Sweeps run in whole vectors, past the count into unused slots.
+struct alignas(16) HighEntities {
+    // relative to camera
+    f32 p_x[MAX_HIGH_ENTITY_COUNT];
+    f32 p_y[MAX_HIGH_ENTITY_COUNT];
+    f32 dp_x[MAX_HIGH_ENTITY_COUNT];
+    f32 dp_y[MAX_HIGH_ENTITY_COUNT];
+    f32 z[MAX_HIGH_ENTITY_COUNT];
+    f32 dz[MAX_HIGH_ENTITY_COUNT];
 
-    u32 low_entity_index;
+    u32 facing_direction[MAX_HIGH_ENTITY_COUNT];
+    u32 chunk_z[MAX_HIGH_ENTITY_COUNT];
+    u32 low_entity_index[MAX_HIGH_ENTITY_COUNT];
 };
 
-struct LowEntity {
-    EntityType type;
-    WorldPosition p;
+// What every entity of a type has in common, so the low entities don't each carry a copy.
+struct EntityTypeTemplate {
+    // the size of one unit, a low entity is size_x by size_y of them
     f32 width, height;
+    bool collides;
 
     // this is for stairs
-    bool collides;
     s32 d_abs_tile_z;
+};
+
+// A canonical WorldPosition, whose offsets always fit in 16 bits.
+struct PackedWorldPosition {
+    s32 chunk_x;
+    s32 chunk_y;
+    s32 chunk_z;
+    s16 offset_x;
+    s16 offset_y;
+};
 
+// The fields set_camera and the per frame passes read. Everything else is in LowEntityCold,
+// so a scan over the entities of a chunk touches 24 bytes per entity.
+struct LowEntity {
+    PackedWorldPosition p;
     u32 high_entity_index;
+
+    u8 type;
+    // in units of the type's template, walls are size_x by size_y tiles
+    u8 size_x;
+    u8 size_y;
+};
+
+struct LowEntityCold {
+    // where the entity sits in its chunk's block list, so leaving a chunk doesn't need a scan
+    WorldEntityBlock* block;
+    u32 index_in_block;
+
+    // freed slots are ET_NULL and linked through this
+    u32 next_free;
+};
+
+// Low entities live in pages pushed on the world arena as they are needed, so an index maps
+// to its page with a shift and a slot is never moved once it has been handed out.
+#define LOW_ENTITY_PAGE_SHIFT 12
+#define LOW_ENTITY_PAGE_SIZE (1 << LOW_ENTITY_PAGE_SHIFT)
+#define LOW_ENTITY_PAGE_MASK (LOW_ENTITY_PAGE_SIZE - 1)
+#define MAX_LOW_ENTITY_PAGE_COUNT 1024
+
+struct LowEntityPage {
+    LowEntity hot[LOW_ENTITY_PAGE_SIZE];
+    LowEntityCold cold[LOW_ENTITY_PAGE_SIZE];
+    // bumped whenever the slot is freed
+    u32 generation[LOW_ENTITY_PAGE_SIZE];
+};
+
+// For holding on to an entity across frames. It goes stale when the entity is freed, rather
+// than pointing at whatever gets the slot next.
+struct LowEntityReference {
+    u32 index;
+    u32 generation;
 };
 
 struct Entity {
     u32 low_index;
-    HighEntity* high;
+    u32 high_index;
     LowEntity* low;
 };
 
-struct LowEntityChunkReference {
-    WorldChunk* tile_chunk;
-    u32 entity_index_in_chunk;
+#define COLLISION_GRID_DIM 64
+
+// singly linked per cell, index 0 is the null node
+struct CollisionGridNode {
+    u32 low_entity_index;
+    u32 next;
+};
+
+// Uniform grid over the colliding high entities in camera space, entities are linked into
+// every cell their bounds touch. It is rebuilt every frame because set_camera shifts all high
+// positions, and kept up to date for movers and entities changing frequency until then.
+struct CollisionGrid {
+    bool is_valid;
+    f32 cell_side_in_meters;
+    V2 origin;
+
+    u32 first_node[COLLISION_GRID_DIM * COLLISION_GRID_DIM];
+    u32 node_count;
+    u32 first_free_node;
+    CollisionGridNode nodes[4 * MAX_HIGH_ENTITY_COUNT + 1];
+};
+
+// Scratch for move_player. Candidates are packed one field per array so the narrow phase can
+// test a vector of them at a time, the tail is padded with candidates that can never be hit.
+struct alignas(16) CollisionCandidates {
+    f32 rel_x[MAX_HIGH_ENTITY_COUNT];
+    f32 rel_y[MAX_HIGH_ENTITY_COUNT];
+    // half extents of the minkowski sum with the mover
+    f32 radius_x[MAX_HIGH_ENTITY_COUNT];
+    f32 radius_y[MAX_HIGH_ENTITY_COUNT];
+
+    u32 high_index[MAX_HIGH_ENTITY_COUNT];
+    u32 count;
+};
+
+#define ROOM_TILE_COUNT_X 17
+#define ROOM_TILE_COUNT_Y 9
+// the most chunks a room can straddle along each axis
+#define ROOM_CHUNK_SPAN_X ((ROOM_TILE_COUNT_X + TILES_PER_CHUNK - 2) / TILES_PER_CHUNK + 1)
+#define ROOM_CHUNK_SPAN_Y ((ROOM_TILE_COUNT_Y + TILES_PER_CHUNK - 2) / TILES_PER_CHUNK + 1)
+
+// One screen of the generated world, laid out in order along the walk. Its walls go in on the
+// workers the first time a chunk it overlaps is generated.
+struct WorldRoom {
+    s32 screen_x;
+    s32 screen_y;
+    s32 abs_tile_z;
+
+    bool door_left;
+    bool door_right;
+    bool door_top;
+    bool door_bottom;
+    bool door_up;
+    bool door_down;
+
+    bool walls_emitted;
+    WorldChunk* chunks[ROOM_CHUNK_SPAN_Y][ROOM_CHUNK_SPAN_X];
+};
+
+// The walk only ever goes up or right, so rooms are laid out just as far as the camera has
+// needed and nothing is spent on the parts of the world nobody has been near.
+struct WorldGenerator {
+    PlatformWorkQueue* queue;
+    RandomSeries series;
+    u32 room_count;
+    u32 rooms_laid_out;
+
+    // where the next room goes and the doors leading into it
+    s32 screen_x;
+    s32 screen_y;
+    s32 abs_tile_z;
+    bool door_left;
+    bool door_bottom;
+    bool door_up;
+    bool door_down;
+};
+
+// every entity in these chunks is high frequency, max is exclusive
+struct SimChunkRegion {
+    s32 min_chunk_x;
+    s32 min_chunk_y;
+    s32 max_chunk_x;
+    s32 max_chunk_y;
+    s32 chunk_z;
+};
+
+// In chunks around the sim region. Chunks are read back in a little before the sim region
+// reaches them, and written out once they have been further than the page out radius for a
+// while. Only generated chunks without heroes are paged out, so nothing else holds their
+// entities' indices.
+#define CHUNK_READ_AHEAD_RADIUS 2
+#define CHUNK_PAGE_OUT_RADIUS 4
+#define CHUNK_PAGE_OUT_FRAMES 300
+#define CHUNK_PAGE_OUT_SCAN_COUNT 64
+
+// a paged out chunk in the swap file, entity_count LowEntity records follow it
+struct ChunkSwapHeader {
+    WorldChunk chunk;
+    u32 entity_count;
+};
+
+struct ChunkPager {
+    PlatformFileHandle swap_file;
+    u64 swap_file_size;
+
+    // the page out scan goes round the chunk hash a few slots a frame
+    u32 scan_slot_index;
+
+    u32 paged_out_count;
+    u32 paged_in_count;
 };
 
 struct GameState {
     MemoryArena world_arena;
     World* world;
 
-    u32 camera_following_entity_index;
+    LowEntityReference camera_following_entity_ref;
     WorldPosition camera_p;
+    SimChunkRegion sim_region;
+    WorldGenerator world_generator;
 
-    u32 player_index_for_controller[array_count(((GameInput*)0)->controllers)];
+    LowEntityReference player_ref_for_controller[array_count(((GameInput*)0)->controllers)];
 
     u32 high_entity_count;
-    HighEntity high_entities_[256];
+    HighEntities high_entities;
+    CollisionGrid collision_grid;
+    CollisionCandidates collision_candidates;
+
+    u32 frame_index;
+    ChunkPager chunk_pager;
 
     u32 low_entity_count;
-    LowEntity low_entities[100000];
+    u32 free_low_entity_count;
+    u32 first_free_low_entity_index;
+    u32 low_entity_page_count;
+    LowEntityPage* low_entity_pages[MAX_LOW_ENTITY_PAGE_COUNT];
 
-    LoadedBitmap backdrop;
-    LoadedBitmap shadow;
-    HeroBitmaps hero_bitmaps[4];
-    LoadedBitmap tree;
+    EntityTypeTemplate entity_templates[ET_COUNT];
+
+#if HANDMADE_INTERNAL
+    ArenaTelemetry world_arena_telemetry;
+#endif
 };
 
+// What a world snapshot keeps of GameState besides the world arena, which has the low entity
+// pages in it. The high entities and the collision state are rebuilt by set_camera once it is
+// loaded.
+struct GameStateSnapshot {
+    LowEntityReference camera_following_entity_ref;
+    WorldPosition camera_p;
+    WorldGenerator world_generator;
+
+    LowEntityReference player_ref_for_controller[array_count(((GameState*)0)->player_ref_for_controller)];
+
+    u32 frame_index;
+    u32 free_low_entity_count;
+    u32 first_free_low_entity_index;
+};
+
+struct TransientState {
+    bool is_initialized;
+    MemoryArena tran_arena;
+    // cleared at the top of every frame, for scratch that doesn't outlive it
+    MemoryArena frame_arena;
+#if HANDMADE_INTERNAL
+    ArenaTelemetry tran_arena_telemetry;
+    ArenaTelemetry frame_arena_telemetry;
+#endif
+    RenderGroup* render_group;
+    Assets* assets;
+};
+
+internal LowEntityPage* get_low_entity_page(GameState* game_state, u32 index) {
+    assert((index >> LOW_ENTITY_PAGE_SHIFT) < game_state->low_entity_page_count);
+    return game_state->low_entity_pages[index >> LOW_ENTITY_PAGE_SHIFT];
+}
+
+internal LowEntity* get_low_entity(GameState* game_state, u32 index) {
+    LowEntity* result = 0;
+
+    if (index > 0 && index < game_state->low_entity_count) {
+        result = get_low_entity_page(game_state, index)->hot + (index & LOW_ENTITY_PAGE_MASK);
+    }
+
+    return result;
+}
+
+internal LowEntityCold* get_low_entity_cold(GameState* game_state, u32 index) {
+    LowEntityCold* result = 0;
+
+    if (index > 0 && index < game_state->low_entity_count) {
+        result = get_low_entity_page(game_state, index)->cold + (index & LOW_ENTITY_PAGE_MASK);
+    }
+
+    return result;
+}
+
+internal LowEntityReference get_low_entity_reference(GameState* game_state, u32 index) {
+    LowEntityReference result = {};
+
+    if (get_low_entity(game_state, index)) {
+        result.index = index;
+        result.generation = get_low_entity_page(game_state, index)->generation[index & LOW_ENTITY_PAGE_MASK];
+    }
+
+    return result;
+}
+
+// 0 if the reference is empty or the entity has been freed since
+internal u32 get_low_entity_index(GameState* game_state, LowEntityReference reference) {
+    u32 result = 0;
+
+    if (get_low_entity(game_state, reference.index) &&
+        get_low_entity_page(game_state, reference.index)->generation[reference.index & LOW_ENTITY_PAGE_MASK] == reference.generation) {
+        result = reference.index;
+    }
+
+    return result;
+}
+
+internal WorldPosition unpack_world_position(PackedWorldPosition* packed) {
+    WorldPosition result;
+    result.chunk_x = packed->chunk_x;
+    result.chunk_y = packed->chunk_y;
+    result.chunk_z = packed->chunk_z;
+    result.offset_x = packed->offset_x;
+    result.offset_y = packed->offset_y;
+    return result;
+}
+
+internal PackedWorldPosition pack_world_position(WorldPosition* p) {
+    assert(p->offset_x >= -WORLD_CHUNK_HALF && p->offset_x < WORLD_CHUNK_HALF);
+    assert(p->offset_y >= -WORLD_CHUNK_HALF && p->offset_y < WORLD_CHUNK_HALF);
+
+    PackedWorldPosition result;
+    result.chunk_x = p->chunk_x;
+    result.chunk_y = p->chunk_y;
+    result.chunk_z = p->chunk_z;
+    result.offset_x = (s16)p->offset_x;
+    result.offset_y = (s16)p->offset_y;
+    return result;
+}
+
+internal V2 get_entity_dim(GameState* game_state, LowEntity* low) {
+    EntityTypeTemplate* entity_template = game_state->entity_templates + low->type;
+    return v2(entity_template->width * (f32)low->size_x, entity_template->height * (f32)low->size_y);
+}
+
+internal bool entity_collides(GameState* game_state, LowEntity* low) {
+    return game_state->entity_templates[low->type].collides;
+}
+
 internal void initialize_arena(MemoryArena* arena, size_t size, u8* base) {
     arena->size = size;
     arena->base = base;
     arena->used = 0;
+    arena->temp_count = 0;
+#if HANDMADE_INTERNAL
+    arena->telemetry = 0;
+#endif
+}
+
+#if HANDMADE_INTERNAL
+internal void attach_arena_telemetry(MemoryArena* arena, ArenaTelemetry* telemetry, char* name) {
+    arena->telemetry = telemetry;
+    u32 length = 0;
+    while (name[length] && length < array_count(telemetry->name) - 1) {
+        telemetry->name[length] = name[length];
+        ++length;
+    }
+    telemetry->name[length] = 0;
+    if (telemetry->peak_used < arena->used) {
+        telemetry->peak_used = arena->used;
+    }
+}
+
+// the stored location is cut to fit, past that two names count as the same call site
+internal bool is_arena_call_site(ArenaCallSite* site, char* file_name) {
+    for (u32 i = 0; i < array_count(site->location) - 1; ++i) {
+        if (site->location[i] != file_name[i]) return false;
+        if (!file_name[i]) return true;
+    }
+    return true;
+}
+
+internal void record_arena_push(MemoryArena* arena, size_t size, char* location) {
+    ArenaTelemetry* telemetry = arena->telemetry;
+    ++telemetry->push_count;
+    telemetry->pushed_size += size;
+    ++telemetry->frame_push_count;
+    telemetry->frame_pushed_size += size;
+    if (telemetry->peak_used < arena->used) {
+        telemetry->peak_used = arena->used;
+    }
+
+    // just the file name, msvc passes the full path
+    char* file_name = location;
+    for (char* at = location; *at; ++at) {
+        if (*at == '/' || *at == '\\') {
+            file_name = at + 1;
+        }
+    }
+
+    u32 hash = 2166136261u;
+    for (char* at = file_name; *at; ++at) {
+        hash = (hash ^ (u8)*at) * 16777619u;
+    }
+
+    // a full table drops the new call site, the arena totals still count it
+    u32 mask = MAX_ARENA_CALL_SITES - 1;
+    for (u32 probe = 0; probe < MAX_ARENA_CALL_SITES; ++probe) {
+        ArenaCallSite* site = telemetry->call_sites + ((hash + probe) & mask);
+        if (!site->push_count) {
+            site->hash = hash;
+            u32 length = 0;
+            while (file_name[length] && length < array_count(site->location) - 1) {
+                site->location[length] = file_name[length];
+                ++length;
+            }
+            site->location[length] = 0;
+            ++telemetry->call_site_count;
+        } else if (site->hash != hash || !is_arena_call_site(site, file_name)) {
+            continue;
+        }
+
+        ++site->push_count;
+        site->pushed_size += size;
+        break;
+    }
+}
+
+internal void begin_arena_telemetry_frame(ArenaTelemetry* telemetry) {
+    telemetry->last_frame_push_count = telemetry->frame_push_count;
+    telemetry->last_frame_pushed_size = telemetry->frame_pushed_size;
+    telemetry->frame_push_count = 0;
+    telemetry->frame_pushed_size = 0;
 }
+#endif
 
-#define push_struct(arena, type) (type*)push_struct_(arena, sizeof(type))
-#define push_array(arena, count, type) (type*)push_struct_(arena, (count) * sizeof(type))
-internal void* push_struct_(MemoryArena* arena, size_t size) {
-    assert((arena->used + size) <= arena->size);
-    void* result = arena->base + arena->used;
-    arena->used += size;
+internal size_t get_alignment_offset(MemoryArena* arena, size_t alignment) {
+    assert(alignment && !(alignment & (alignment - 1)));
+    size_t alignment_mask = alignment - 1;
+    size_t result_pointer = (size_t)arena->base + arena->used;
+    return (alignment - (result_pointer & alignment_mask)) & alignment_mask;
+}
+
+// Structs and arrays come back aligned for their type, so alignas(16) SIMD layouts work
+// straight out of an arena. Untyped pushes say what they need, like 64 for something that
+// should start on a cache line.
+#define push_struct(arena, type) (type*)push_size_(arena, sizeof(type), alignof(type), ARENA_CALL_SITE)
+#define push_array(arena, count, type) (type*)push_size_(arena, (count) * sizeof(type), alignof(type), ARENA_CALL_SITE)
+#define push_size(arena, size, alignment) push_size_(arena, size, alignment, ARENA_CALL_SITE)
+internal void* push_size_(MemoryArena* arena, size_t size, size_t alignment, char* location) {
+    size_t alignment_offset = get_alignment_offset(arena, alignment);
+    assert((arena->used + alignment_offset + size) <= arena->size);
+    void* result = arena->base + arena->used + alignment_offset;
+    arena->used += alignment_offset + size;
+#if HANDMADE_INTERNAL
+    if (arena->telemetry) {
+        record_arena_push(arena, alignment_offset + size, location);
+    }
+#endif
+    return result;
+}
+
+// carves a block out of the arena that can be cleared or scoped without touching the rest
+#define sub_arena(result, arena, size) initialize_arena(result, size, (u8*)push_size(arena, size, 16))
+
+internal TemporaryMemory begin_temporary_memory(MemoryArena* arena) {
+    TemporaryMemory result;
+    result.arena = arena;
+    result.used = arena->used;
+    ++arena->temp_count;
     return result;
 }
+
+internal void end_temporary_memory(TemporaryMemory temp) {
+    MemoryArena* arena = temp.arena;
+    assert(arena->used >= temp.used);
+    assert(arena->temp_count > 0);
+    arena->used = temp.used;
+    --arena->temp_count;
+}
+
+internal void check_arena(MemoryArena* arena) {
+    assert(arena->temp_count == 0);
+}
+
+internal void clear_arena(MemoryArena* arena) {
+    check_arena(arena);
+    arena->used = 0;
+}
+
+internal void copy_memory(size_t size, void* source_init, void* dest_init) {
+    u8* source = (u8*)source_init;
+    u8* dest = (u8*)dest_init;
+    while (size--) {
+        *dest++ = *source++;
+    }
+}
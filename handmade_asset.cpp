@@ -0,0 +1,211 @@
+#include "handmade_asset.h"
+
+// keeps the pixels that follow a block header on the same alignment they have in the file
+#define ASSET_BLOCK_HEADER_SIZE ((sizeof(AssetMemoryBlock) + HHA_PIXEL_ALIGNMENT - 1) & ~(u64)(HHA_PIXEL_ALIGNMENT - 1))
+
+internal u64 align_asset_size(u64 size) {
+    return (size + HHA_PIXEL_ALIGNMENT - 1) & ~(u64)(HHA_PIXEL_ALIGNMENT - 1);
+}
+
+internal void* get_block_memory(AssetMemoryBlock* block) {
+    return (u8*)block + ASSET_BLOCK_HEADER_SIZE;
+}
+
+internal void insert_block_after(AssetMemoryBlock* prev, AssetMemoryBlock* block) {
+    block->prev = prev;
+    block->next = prev->next;
+    block->prev->next = block;
+    block->next->prev = block;
+}
+
+// first fit, splitting off the tail when it is big enough to be useful
+internal AssetMemoryBlock* allocate_block(Assets* assets, u64 size) {
+    size = align_asset_size(size);
+
+    AssetMemoryBlock* sentinel = &assets->memory_sentinel;
+    for (AssetMemoryBlock* block = sentinel->next; block != sentinel; block = block->next) {
+        if (!block->used && block->size >= size) {
+            u64 remaining = block->size - size;
+            if (remaining >= ASSET_BLOCK_HEADER_SIZE + HHA_PIXEL_ALIGNMENT) {
+                AssetMemoryBlock* split = (AssetMemoryBlock*)((u8*)get_block_memory(block) + size);
+                split->size = remaining - ASSET_BLOCK_HEADER_SIZE;
+                split->used = false;
+                insert_block_after(block, split);
+
+                block->size = size;
+            }
+
+            block->used = true;
+            return block;
+        }
+    }
+
+    return NULL;
+}
+
+internal void merge_if_possible(Assets* assets, AssetMemoryBlock* first, AssetMemoryBlock* second) {
+    AssetMemoryBlock* sentinel = &assets->memory_sentinel;
+    if (first != sentinel && second != sentinel && !first->used && !second->used) {
+        // the budget is one contiguous region kept in address order, so neighbours are adjacent
+        assert((u8*)get_block_memory(first) + first->size == (u8*)second);
+
+        first->size += ASSET_BLOCK_HEADER_SIZE + second->size;
+        second->prev->next = second->next;
+        second->next->prev = second->prev;
+    }
+}
+
+internal void free_block(Assets* assets, AssetMemoryBlock* block) {
+    AssetMemoryBlock* prev = block->prev;
+    block->used = false;
+    merge_if_possible(assets, block, block->next);
+    merge_if_possible(assets, prev, block);
+}
+
+internal void remove_from_lru(AssetSlot* slot) {
+    slot->lru_prev->lru_next = slot->lru_next;
+    slot->lru_next->lru_prev = slot->lru_prev;
+    slot->lru_prev = slot->lru_next = NULL;
+}
+
+internal void insert_at_lru_front(Assets* assets, AssetSlot* slot) {
+    AssetSlot* sentinel = &assets->lru_sentinel;
+    slot->lru_prev = sentinel;
+    slot->lru_next = sentinel->lru_next;
+    slot->lru_prev->lru_next = slot;
+    slot->lru_next->lru_prev = slot;
+}
+
+// Anything handed out this frame may still be sitting in the render group, and a queued slot
+// still has a worker writing into its block, so neither can go.
+internal bool evict_least_recently_used(Assets* assets) {
+    AssetSlot* sentinel = &assets->lru_sentinel;
+    for (AssetSlot* slot = sentinel->lru_prev; slot != sentinel; slot = slot->lru_prev) {
+        if (slot->last_used_frame != assets->frame_index && atomic_load_acquire_u32(&slot->state) == AS_LOADED) {
+            remove_from_lru(slot);
+            free_block(assets, slot->block);
+            slot->block = NULL;
+            slot->bitmap.pixels = NULL;
+            slot->state = AS_UNLOADED;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(load_asset_work) {
+    AssetSlot* slot = (AssetSlot*)data;
+
+    // touching the mapping is where the actual file i/o happens
+    u32* source = slot->source_pixels;
+    u32* dest = slot->bitmap.pixels;
+    u32 pixel_count = slot->bitmap.width * slot->bitmap.height;
+    for (u32 pixel_index = 0; pixel_index < pixel_count; ++pixel_index) {
+        dest[pixel_index] = source[pixel_index];
+    }
+
+    atomic_store_release_u32(&slot->state, AS_LOADED);
+}
+
+internal void load_bitmap(Assets* assets, AssetBitmapId id) {
+    assert(id < ABI_COUNT);
+    AssetSlot* slot = assets->slots + id;
+    if (slot->state != AS_UNLOADED) {
+        return;
+    }
+
+    HHABitmap* source = slot->source;
+    AssetMemoryBlock* block = allocate_block(assets, (u64)source->width * source->height * sizeof(u32));
+    while (!block) {
+        if (!evict_least_recently_used(assets)) {
+            // everything resident is in use this frame, try again next frame
+            return;
+        }
+        block = allocate_block(assets, (u64)source->width * source->height * sizeof(u32));
+    }
+
+    slot->block = block;
+    slot->bitmap.width = source->width;
+    slot->bitmap.height = source->height;
+    slot->bitmap.align_x = source->align_x;
+    slot->bitmap.align_y = source->align_y;
+    slot->bitmap.pixels = (u32*)get_block_memory(block);
+    slot->last_used_frame = assets->frame_index;
+    slot->state = AS_QUEUED;
+    insert_at_lru_front(assets, slot);
+
+    if (assets->load_queue) {
+        platform_add_entry(assets->load_queue, load_asset_work, slot);
+    } else {
+        load_asset_work(NULL, slot);
+    }
+}
+
+// Never waits, returns NULL until the bitmap has been streamed in.
+internal LoadedBitmap* get_bitmap(Assets* assets, AssetBitmapId id) {
+    assert(id < ABI_COUNT);
+    AssetSlot* slot = assets->slots + id;
+
+    LoadedBitmap* result = NULL;
+    u32 state = atomic_load_acquire_u32(&slot->state);
+    if (state == AS_LOADED) {
+        slot->last_used_frame = assets->frame_index;
+        remove_from_lru(slot);
+        insert_at_lru_front(assets, slot);
+        result = &slot->bitmap;
+    } else if (state == AS_UNLOADED) {
+        load_bitmap(assets, id);
+    }
+
+    return result;
+}
+
+internal void begin_asset_frame(Assets* assets) {
+    ++assets->frame_index;
+}
+
+internal Assets* allocate_game_assets(MemoryArena* arena, size_t budget, PlatformWorkQueue* load_queue,
+                                      platform_map_file_func* map_file, char* filename) {
+    Assets* assets = push_struct(arena, Assets);
+    *assets = {};
+    assets->load_queue = load_queue;
+
+    assets->file = map_file(filename);
+    HHAHeader* header = (HHAHeader*)assets->file.contents;
+    assert(header);
+    assert(assets->file.size >= sizeof(HHAHeader));
+    assert(header->magic_value == HHA_MAGIC_VALUE);
+    assert(header->version == HHA_VERSION);
+    assert(header->bitmap_count == ABI_COUNT);
+    assert(header->bitmaps + header->bitmap_count * sizeof(HHABitmap) <= assets->file.size);
+
+    HHABitmap* source_bitmaps = (HHABitmap*)((u8*)assets->file.contents + header->bitmaps);
+    for (u32 bitmap_index = 0; bitmap_index < ABI_COUNT; ++bitmap_index) {
+        HHABitmap* source = source_bitmaps + bitmap_index;
+        assert((source->pixels % HHA_PIXEL_ALIGNMENT) == 0);
+        assert(source->pixels + (u64)source->width * source->height * sizeof(u32) <= assets->file.size);
+
+        AssetSlot* slot = assets->slots + bitmap_index;
+        slot->state = AS_UNLOADED;
+        slot->source = source;
+        slot->source_pixels = (u32*)((u8*)assets->file.contents + source->pixels);
+    }
+
+    assets->lru_sentinel.lru_prev = &assets->lru_sentinel;
+    assets->lru_sentinel.lru_next = &assets->lru_sentinel;
+
+    u8* memory = (u8*)push_size(arena, budget, HHA_PIXEL_ALIGNMENT);
+    assert(budget > ASSET_BLOCK_HEADER_SIZE);
+
+    AssetMemoryBlock* sentinel = &assets->memory_sentinel;
+    sentinel->prev = sentinel;
+    sentinel->next = sentinel;
+
+    AssetMemoryBlock* block = (AssetMemoryBlock*)memory;
+    block->size = budget - ASSET_BLOCK_HEADER_SIZE;
+    block->used = false;
+    insert_block_after(sentinel, block);
+
+    return assets;
+}
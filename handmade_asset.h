@@ -0,0 +1,46 @@
+#pragma once
+
+#include "handmade_file_formats.h"
+
+enum AssetState {
+    AS_UNLOADED,
+    AS_QUEUED,
+    AS_LOADED,
+};
+
+// header in front of every allocation in the asset budget, blocks are kept in address order
+struct AssetMemoryBlock {
+    AssetMemoryBlock* prev;
+    AssetMemoryBlock* next;
+    u64 size;
+    bool used;
+};
+
+struct AssetSlot {
+    // written by the loading worker with release, read on the main thread with acquire
+    u32 volatile state;
+    u32 last_used_frame;
+
+    HHABitmap* source;
+    u32* source_pixels;
+    AssetMemoryBlock* block;
+    LoadedBitmap bitmap;
+
+    // queued and loaded slots are on the lru list, most recently used first
+    AssetSlot* lru_prev;
+    AssetSlot* lru_next;
+};
+
+// The mapped file is the backing store. Bitmaps are copied into a fixed budget on the low
+// priority queue the first time they are asked for, and the least recently used ones are
+// evicted when the budget runs out. Everything except the copy happens on the main thread.
+struct Assets {
+    PlatformMappedFile file;
+    PlatformWorkQueue* load_queue;
+    u32 frame_index;
+
+    AssetMemoryBlock memory_sentinel;
+    AssetSlot lru_sentinel;
+
+    AssetSlot slots[ABI_COUNT];
+};
@@ -0,0 +1,77 @@
+#pragma once
+
+// Packed asset file, written offline by asset_packer.cpp and memory mapped by the game.
+// Offsets are from the start of the file.
+
+enum AssetBitmapId {
+    ABI_BACKDROP,
+    ABI_SHADOW,
+    ABI_TREE,
+
+    // hero parts are in facing_direction order: right, back, left, front
+    ABI_HERO_HEAD_RIGHT,
+    ABI_HERO_HEAD_BACK,
+    ABI_HERO_HEAD_LEFT,
+    ABI_HERO_HEAD_FRONT,
+
+    ABI_HERO_CAPE_RIGHT,
+    ABI_HERO_CAPE_BACK,
+    ABI_HERO_CAPE_LEFT,
+    ABI_HERO_CAPE_FRONT,
+
+    ABI_HERO_TORSO_RIGHT,
+    ABI_HERO_TORSO_BACK,
+    ABI_HERO_TORSO_LEFT,
+    ABI_HERO_TORSO_FRONT,
+
+    ABI_COUNT,
+};
+
+#define HHA_MAGIC_VALUE (((u32)'h' << 0) | ((u32)'h' << 8) | ((u32)'a' << 16) | ((u32)'f' << 24))
+#define HHA_VERSION 1
+// pixel data starts on a cache line so rows can be streamed straight out of the mapping
+#define HHA_PIXEL_ALIGNMENT 64
+
+#pragma pack(push, 1)
+struct HHAHeader {
+    u32 magic_value;
+    u32 version;
+    u32 bitmap_count;
+    u32 reserved;
+    u64 bitmaps; // HHABitmap[bitmap_count], indexed by AssetBitmapId
+};
+
+struct HHABitmap {
+    s32 width;
+    s32 height;
+    s32 align_x;
+    s32 align_y;
+    u64 pixels; // top down, premultiplied 0xAARRGGBB, pitch == width
+};
+#pragma pack(pop)
+
+// World snapshot, written and read back by the game. The sections are copies of the game's
+// own structs, so a snapshot only loads into a build with the same layout, the sizes in the
+// header are there to catch that. Pointers into the world arena are stored as offsets from the
+// start of the file, which keeps the file independent of where the arena was.
+#define HHS_MAGIC_VALUE (((u32)'h' << 0) | ((u32)'h' << 8) | ((u32)'s' << 16) | ((u32)'f' << 24))
+#define HHS_VERSION 3
+
+#pragma pack(push, 1)
+struct HHSHeader {
+    u32 magic_value;
+    u32 version;
+    u32 game_state_size;
+    u32 low_entity_page_size;
+    u32 world_chunk_size;
+    u32 low_entity_count;
+    u32 low_entity_page_count;
+
+    u64 game_state;    // GameStateSnapshot
+    u64 low_entity_pages; // u64[low_entity_page_count], offsets of the pages in the world arena
+    u64 world_arena;   // the used part of the world arena, the World is at its start
+    u64 world_arena_size;
+    u64 swap;          // the chunk swap file, paged out chunks keep their offsets into it
+    u64 swap_size;
+};
+#pragma pack(pop)
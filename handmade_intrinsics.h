@@ -1,5 +1,14 @@
 #pragma once
-#include "math.h"
+
+#if COMPILER_MSVC
+#include <intrin.h>
+// msvc lets any function use avx2 intrinsics, gcc/clang need the target attribute
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#include <immintrin.h>
 
 internal f32 square_root(f32 float_32) {
     f32 result = sqrtf(float_32);
@@ -31,15 +40,15 @@ internal s32 ceil_f32_to_s32(f32 float_32) {
     return (s32)ceilf(float_32);
 }
 
-internal f32 sin(f32 angle) {
+internal f32 sine(f32 angle) {
     return sinf(angle);
 }
 
-internal f32 cos(f32 angle) {
+internal f32 cosine(f32 angle) {
     return cosf(angle);
 }
 
-internal f32 atan2(f32 y, f32 x) {
+internal f32 arc_tangent2(f32 y, f32 x) {
     return atan2f(y, x);
 }
 
@@ -59,3 +68,49 @@ internal u32 find_least_significant_set_bit(u32 value) {
     return 0;
 #endif
 }
+
+struct CpuFeatures {
+    bool sse2;
+    bool avx2;
+};
+
+internal void cpuid(u32 leaf, u32 sub_leaf, u32* regs) {
+#if COMPILER_MSVC
+    __cpuidex((int*)regs, leaf, sub_leaf);
+#else
+    __cpuid_count(leaf, sub_leaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+internal u64 read_xcr0() {
+#if COMPILER_MSVC
+    return _xgetbv(0);
+#else
+    u32 eax, edx;
+    __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+    return ((u64)edx << 32) | eax;
+#endif
+}
+
+internal CpuFeatures get_cpu_features() {
+    CpuFeatures result = {};
+
+    u32 regs[4] = {};
+    cpuid(0, 0, regs);
+    u32 max_leaf = regs[0];
+
+    cpuid(1, 0, regs);
+    result.sse2 = (regs[3] & (1 << 26)) != 0;
+    bool os_saves_ymm = false;
+    if ((regs[2] & (1 << 27)) && (regs[2] & (1 << 28))) {
+        // osxsave + avx, check the os actually saves xmm/ymm state
+        os_saves_ymm = (read_xcr0() & 6) == 6;
+    }
+
+    if (max_leaf >= 7 && os_saves_ymm) {
+        cpuid(7, 0, regs);
+        result.avx2 = (regs[1] & (1 << 5)) != 0;
+    }
+
+    return result;
+}
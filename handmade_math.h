@@ -1,4 +1,6 @@
 #pragma once
+// ahead of the min/max macros in handmade.h, libstdc++ headers undef them
+#include <math.h>
 
 union V2 {
     struct {
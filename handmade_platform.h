@@ -18,6 +18,7 @@ extern "C" {
 #undef COMPILER_MSVC
 #define COMPILER_MSVC 1
 #else
+#undef COMPILER_LLVM
 #define COMPILER_LLVM 1
 #endif
 #endif
@@ -56,6 +57,56 @@ typedef double f64;
 
 #define INVALID_CODE_PATH assert(!"Invalid Code Path")
 
+// atomics, the returned value is always the one before the operation
+#if COMPILER_MSVC
+#include <intrin.h>
+
+internal u32 atomic_compare_exchange_u32(u32 volatile* value, u32 new_value, u32 expected) {
+    return (u32)_InterlockedCompareExchange((long volatile*)value, (long)new_value, (long)expected);
+}
+
+internal u32 atomic_add_u32(u32 volatile* value, u32 addend) {
+    return (u32)_InterlockedExchangeAdd((long volatile*)value, (long)addend);
+}
+
+internal u32 atomic_load_acquire_u32(u32 volatile* value) {
+    // x64 loads already have acquire semantics, only the compiler needs fencing
+    u32 result = *value;
+    _ReadWriteBarrier();
+    return result;
+}
+
+internal void atomic_store_release_u32(u32 volatile* value, u32 new_value) {
+    _ReadWriteBarrier();
+    *value = new_value;
+}
+
+internal u16 atomic_or_u16(u16 volatile* value, u16 bits) {
+    return (u16)_InterlockedOr16((short volatile*)value, (short)bits);
+}
+#else
+internal u32 atomic_compare_exchange_u32(u32 volatile* value, u32 new_value, u32 expected) {
+    __atomic_compare_exchange_n(value, &expected, new_value, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    return expected;
+}
+
+internal u32 atomic_add_u32(u32 volatile* value, u32 addend) {
+    return __atomic_fetch_add(value, addend, __ATOMIC_ACQ_REL);
+}
+
+internal u32 atomic_load_acquire_u32(u32 volatile* value) {
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+internal void atomic_store_release_u32(u32 volatile* value, u32 new_value) {
+    __atomic_store_n(value, new_value, __ATOMIC_RELEASE);
+}
+
+internal u16 atomic_or_u16(u16 volatile* value, u16 bits) {
+    return __atomic_fetch_or(value, bits, __ATOMIC_ACQ_REL);
+}
+#endif
+
 typedef struct {
     int placeholder;
 } ThreadContext;
@@ -77,6 +128,53 @@ typedef DEBUG_PLATFORM_FREE_FILE_MEMORY(debug_platform_free_file_memory_func);
 
 #endif
 
+typedef struct {
+    u64 size;
+    void* contents;
+} PlatformMappedFile;
+
+// read only, stays mapped until it is unmapped or the process exits
+#define PLATFORM_MAP_FILE(name) PlatformMappedFile name(char* filename)
+typedef PLATFORM_MAP_FILE(platform_map_file_func);
+
+#define PLATFORM_UNMAP_FILE(name) void name(PlatformMappedFile* file)
+typedef PLATFORM_UNMAP_FILE(platform_unmap_file_func);
+
+// Replaces the file only once everything has been written, so a failed write leaves the old
+// one in place.
+#define PLATFORM_WRITE_ENTIRE_FILE(name) bool name(char* filename, u64 size, void* memory)
+typedef PLATFORM_WRITE_ENTIRE_FILE(platform_write_entire_file_func);
+
+typedef struct {
+    bool no_errors;
+    void* platform;
+} PlatformFileHandle;
+
+// Read write scratch file that goes away with the process, for data the game would rather
+// not keep resident. Reads and writes are at explicit offsets and block until they are done.
+#define PLATFORM_OPEN_SWAP_FILE(name) PlatformFileHandle name(char* filename)
+typedef PLATFORM_OPEN_SWAP_FILE(platform_open_swap_file_func);
+
+#define PLATFORM_READ_DATA_FROM_FILE(name) bool name(PlatformFileHandle* handle, u64 offset, u64 size, void* dest)
+typedef PLATFORM_READ_DATA_FROM_FILE(platform_read_data_from_file_func);
+
+#define PLATFORM_WRITE_DATA_TO_FILE(name) bool name(PlatformFileHandle* handle, u64 offset, u64 size, void* source)
+typedef PLATFORM_WRITE_DATA_TO_FILE(platform_write_data_to_file_func);
+
+typedef struct PlatformWorkQueue PlatformWorkQueue;
+#define PLATFORM_WORK_QUEUE_CALLBACK(name) void name(PlatformWorkQueue* queue, void* data)
+typedef PLATFORM_WORK_QUEUE_CALLBACK(platform_work_queue_callback);
+
+// safe to call from any thread, including from inside a callback. data has to stay
+// alive until the work completes. if the queue is full the caller runs queued work
+// until there is room
+#define PLATFORM_ADD_ENTRY(name) void name(PlatformWorkQueue* queue, platform_work_queue_callback* callback, void* data)
+typedef PLATFORM_ADD_ENTRY(platform_add_entry_func);
+
+// the calling thread helps drain the queue and returns once every added entry is done
+#define PLATFORM_COMPLETE_ALL_WORK(name) void name(PlatformWorkQueue* queue)
+typedef PLATFORM_COMPLETE_ALL_WORK(platform_complete_all_work_func);
+
 // Game Structs
 typedef struct {
     void* memory;
@@ -144,6 +242,24 @@ typedef struct {
     u64 transient_storage_size;
     void* transient_storage;
 
+    // high priority is for work the frame waits on (rendering), low priority for
+    // background work that runs on fewer, lower priority threads (asset loads)
+    PlatformWorkQueue* high_priority_queue;
+    PlatformWorkQueue* low_priority_queue;
+    platform_add_entry_func* platform_add_entry;
+    platform_complete_all_work_func* platform_complete_all_work;
+    platform_map_file_func* platform_map_file;
+    platform_unmap_file_func* platform_unmap_file;
+    platform_write_entire_file_func* platform_write_entire_file;
+    platform_open_swap_file_func* platform_open_swap_file;
+    platform_read_data_from_file_func* platform_read_data_from_file;
+    platform_write_data_to_file_func* platform_write_data_to_file;
+
+    // The world starts from this snapshot if it can be loaded, and is written back to it at the
+    // end of a frame the platform sets snapshot_requested for. No snapshots if it is NULL.
+    char* snapshot_filename;
+    bool snapshot_requested;
+
     debug_platform_free_file_memory_func* debug_platform_free_file_memory;
     debug_platform_read_entire_file_func* debug_platform_read_entire_file;
     debug_platform_write_entire_file_func* debug_platform_write_entire_file;
@@ -167,6 +283,55 @@ typedef GAME_UPDATE_AND_RENDER(game_update_and_render_func);
 #define GAME_GET_SOUND_SAMPLES(name) void name(ThreadContext* thread, GameMemory* memory, GameOutputSoundBuffer* sound_buffer)
 typedef GAME_GET_SOUND_SAMPLES(game_get_sound_samples_func);
 
+#if HANDMADE_INTERNAL
+// Arena telemetry, for sizing the storage blocks from real runs. Peaks are high water marks of
+// an arena's used size and counts are since startup, except the frame ones which cover the
+// last frame that finished. Pushed sizes include alignment padding.
+typedef struct {
+    char* name;
+    u64 size;
+    u64 used;
+    u64 peak_used;
+    u64 push_count;
+    u64 pushed_size;
+    u32 frame_push_count;
+    u64 frame_pushed_size;
+} DebugArenaStats;
+
+typedef struct {
+    char* arena_name;
+    char* location; // file(line) of the push
+    u64 push_count;
+    u64 pushed_size;
+} DebugArenaCallSite;
+
+typedef struct {
+    // the smallest the storage blocks could have been for the run so far
+    u64 permanent_storage_peak;
+    u64 transient_storage_peak;
+
+    u32 arena_count;
+    DebugArenaStats arenas[8];
+
+    // biggest pushed size first, over all arenas
+    u32 call_site_count;
+    DebugArenaCallSite call_sites[32];
+
+    // the world's chunk hash, probe lengths count the home slot so 1 is a direct hit
+    u32 chunk_count;
+    u32 chunk_slot_count;
+    f32 chunk_load_factor;
+    f32 chunk_average_probe_length;
+    u32 chunk_max_probe_length;
+    u64 chunk_lookup_count;
+    u64 chunk_lookup_probe_count;
+} DebugMemoryStats;
+
+// the strings point into game memory, so they survive a code reload
+#define DEBUG_GAME_GET_MEMORY_STATS(name) void name(GameMemory* memory, DebugMemoryStats* stats)
+typedef DEBUG_GAME_GET_MEMORY_STATS(debug_game_get_memory_stats_func);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,34 @@
+#pragma once
+
+// xorshift32, so a seed gives the same sequence on every compiler and libc
+struct RandomSeries {
+    u32 state;
+};
+
+internal RandomSeries random_seed(u32 seed) {
+    RandomSeries result;
+    // xorshift never leaves a zero state, and nearby seeds shouldn't start out alike
+    result.state = (seed * 0x9E3779B9u) ^ 0x6A09E667u;
+    if (result.state == 0) {
+        result.state = 0x6A09E667u;
+    }
+    return result;
+}
+
+internal u32 random_next_u32(RandomSeries* series) {
+    u32 x = series->state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    series->state = x;
+    return x;
+}
+
+internal u32 random_choice(RandomSeries* series, u32 choice_count) {
+    return random_next_u32(series) % choice_count;
+}
+
+// -1 to 1 in steps of 1/32768
+internal f32 random_bilateral(RandomSeries* series) {
+    return (f32)(random_next_u32(series) & 0xFFFF) / 32768.0f - 1.0f;
+}
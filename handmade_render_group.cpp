@@ -0,0 +1,378 @@
+#include "handmade_render_group.h"
+
+internal void draw_rectangle(GameOffscreenBuffer* buffer,
+                             V2 v_min, V2 v_max,
+                             f32 r, f32 g, f32 b,
+                             Rect2i clip_rect) {
+    int min_x = round_f32_to_s32(v_min.x);
+    int min_y = round_f32_to_s32(v_min.y);
+    int max_x = round_f32_to_s32(v_max.x);
+    int max_y = round_f32_to_s32(v_max.y);
+
+    if (min_x < clip_rect.min_x) {
+        min_x = clip_rect.min_x;
+    }
+    if (min_y < clip_rect.min_y) {
+        min_y = clip_rect.min_y;
+    }
+    if (max_x > clip_rect.max_x) {
+        max_x = clip_rect.max_x;
+    }
+    if (max_y > clip_rect.max_y) {
+        max_y = clip_rect.max_y;
+    }
+
+    u32 color = (round_f32_to_s32(r * 255.0f) << 16) |
+                (round_f32_to_s32(g * 255.0f) << 8) |
+                (round_f32_to_s32(b * 255.0f) << 0);
+
+    u8* row = (u8*)buffer->memory + (min_x * buffer->bytes_per_pixel) + (min_y * buffer->pitch);
+    for (s32 y = min_y; y < max_y; ++y) {
+        u32* pixel = (u32*)row;
+        for (s32 x = min_x; x < max_x; ++x) {
+            *pixel++ = color;
+        }
+        row += buffer->pitch;
+    }
+}
+
+// blends count premultiplied source pixels over dest, 0xAARRGGBB.
+// c_alpha is 8.8 fixed point, 256 == 1.0
+typedef void blend_span_func(u32* dest, u32* source, s32 count, u32 c_alpha);
+
+internal void blend_span_scalar(u32* dest, u32* source, s32 count, u32 c_alpha) {
+    for (s32 i = 0; i < count; ++i) {
+        u32 s = *source;
+        u32 d = *dest;
+
+        u32 sa = (((s >> 24) & 0xFF) * c_alpha) >> 8;
+        u32 inv_a = 255 - sa;
+
+        u32 result = 0;
+        for (u32 shift = 0; shift < 32; shift += 8) {
+            u32 sc = (((s >> shift) & 0xFF) * c_alpha) >> 8;
+            // d * inv_a / 255 rounded, without the divide
+            u32 t = ((d >> shift) & 0xFF) * inv_a + 128;
+            result |= (sc + ((t + (t >> 8)) >> 8)) << shift;
+        }
+        *dest = result;
+
+        ++dest;
+        ++source;
+    }
+}
+
+// 2 pixels widened to 8 16-bit channels
+internal __m128i blend_2x_u16_sse2(__m128i s, __m128i d, __m128i c_alpha) {
+    s = _mm_srli_epi16(_mm_mullo_epi16(s, c_alpha), 8);
+    __m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m128i inv_a = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+
+    __m128i t = _mm_add_epi16(_mm_mullo_epi16(d, inv_a), _mm_set1_epi16(128));
+    t = _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+
+    return _mm_add_epi16(s, t);
+}
+
+internal __m128i blend_4x_sse2(__m128i s, __m128i d, __m128i c_alpha) {
+    __m128i zero = _mm_setzero_si128();
+    __m128i lo = blend_2x_u16_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), c_alpha);
+    __m128i hi = blend_2x_u16_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), c_alpha);
+    return _mm_packus_epi16(lo, hi);
+}
+
+internal void blend_span_sse2(u32* dest, u32* source, s32 count, u32 c_alpha) {
+    __m128i c_alpha_8x = _mm_set1_epi16((s16)c_alpha);
+
+    s32 i = 0;
+    for (; i + 4 <= count; i += 4) {
+        __m128i s = _mm_loadu_si128((__m128i*)(source + i));
+        __m128i d = _mm_loadu_si128((__m128i*)(dest + i));
+        _mm_storeu_si128((__m128i*)(dest + i), blend_4x_sse2(s, d, c_alpha_8x));
+    }
+
+    // no masked load/store on sse2, so the clipped edge goes through a padded copy
+    s32 remaining = count - i;
+    if (remaining > 0) {
+        u32 source_edge[4] = {};
+        u32 dest_edge[4] = {};
+        for (s32 j = 0; j < remaining; ++j) {
+            source_edge[j] = source[i + j];
+            dest_edge[j] = dest[i + j];
+        }
+        __m128i s = _mm_loadu_si128((__m128i*)source_edge);
+        __m128i d = _mm_loadu_si128((__m128i*)dest_edge);
+        _mm_storeu_si128((__m128i*)dest_edge, blend_4x_sse2(s, d, c_alpha_8x));
+        for (s32 j = 0; j < remaining; ++j) {
+            dest[i + j] = dest_edge[j];
+        }
+    }
+}
+
+TARGET_AVX2 internal __m256i blend_4x_u16_avx2(__m256i s, __m256i d, __m256i c_alpha) {
+    s = _mm256_srli_epi16(_mm256_mullo_epi16(s, c_alpha), 8);
+    __m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xFF), 0xFF);
+    __m256i inv_a = _mm256_sub_epi16(_mm256_set1_epi16(255), sa);
+
+    __m256i t = _mm256_add_epi16(_mm256_mullo_epi16(d, inv_a), _mm256_set1_epi16(128));
+    t = _mm256_srli_epi16(_mm256_add_epi16(t, _mm256_srli_epi16(t, 8)), 8);
+
+    return _mm256_add_epi16(s, t);
+}
+
+// unpack and pack both work per 128-bit lane, so pixel order comes back out unchanged
+TARGET_AVX2 internal __m256i blend_8x_avx2(__m256i s, __m256i d, __m256i c_alpha) {
+    __m256i zero = _mm256_setzero_si256();
+    __m256i lo = blend_4x_u16_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), c_alpha);
+    __m256i hi = blend_4x_u16_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), c_alpha);
+    return _mm256_packus_epi16(lo, hi);
+}
+
+TARGET_AVX2 internal void blend_span_avx2(u32* dest, u32* source, s32 count, u32 c_alpha) {
+    __m256i c_alpha_16x = _mm256_set1_epi16((s16)c_alpha);
+
+    s32 i = 0;
+    for (; i + 8 <= count; i += 8) {
+        __m256i s = _mm256_loadu_si256((__m256i*)(source + i));
+        __m256i d = _mm256_loadu_si256((__m256i*)(dest + i));
+        _mm256_storeu_si256((__m256i*)(dest + i), blend_8x_avx2(s, d, c_alpha_16x));
+    }
+
+    s32 remaining = count - i;
+    if (remaining > 0) {
+        __m256i edge_mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(remaining),
+                                               _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        __m256i s = _mm256_maskload_epi32((int*)(source + i), edge_mask);
+        __m256i d = _mm256_maskload_epi32((int*)(dest + i), edge_mask);
+        _mm256_maskstore_epi32((int*)(dest + i), edge_mask, blend_8x_avx2(s, d, c_alpha_16x));
+    }
+}
+
+internal blend_span_func* select_blend_span() {
+    CpuFeatures features = get_cpu_features();
+    if (features.avx2) {
+        return blend_span_avx2;
+    } else if (features.sse2) {
+        return blend_span_sse2;
+    }
+    return blend_span_scalar;
+}
+
+// reset on dll reload, draw_bitmap picks it again on first use
+global blend_span_func* g_blend_span;
+
+internal void draw_bitmap(GameOffscreenBuffer* buffer, LoadedBitmap* bitmap,
+                          f32 real_x, f32 real_y,
+                          f32 c_alpha, Rect2i clip_rect) {
+    if (!g_blend_span) {
+        g_blend_span = select_blend_span();
+    }
+
+    real_x -= (f32)bitmap->align_x;
+    real_y -= (f32)bitmap->align_y;
+    s32 min_x = round_f32_to_s32(real_x);
+    s32 min_y = round_f32_to_s32(real_y);
+    s32 max_x = min_x + bitmap->width;
+    s32 max_y = min_y + bitmap->height;
+
+    s32 source_offset_x = 0;
+    if (min_x < clip_rect.min_x) {
+        source_offset_x = clip_rect.min_x - min_x;
+        min_x = clip_rect.min_x;
+    }
+    s32 source_offset_y = 0;
+    if (min_y < clip_rect.min_y) {
+        source_offset_y = clip_rect.min_y - min_y;
+        min_y = clip_rect.min_y;
+    }
+    if (max_x > clip_rect.max_x) {
+        max_x = clip_rect.max_x;
+    }
+    if (max_y > clip_rect.max_y) {
+        max_y = clip_rect.max_y;
+    }
+    if (min_x >= max_x) return;
+
+    if (c_alpha < 0.0f) {
+        c_alpha = 0.0f;
+    }
+    if (c_alpha > 1.0f) {
+        c_alpha = 1.0f;
+    }
+    u32 c_alpha_8_8 = round_f32_to_u32(c_alpha * 256.0f);
+
+    u32* source_row = bitmap->pixels + source_offset_y * bitmap->width + source_offset_x;
+    u8* dest_row = (u8*)buffer->memory + (min_x * buffer->bytes_per_pixel) + (min_y * buffer->pitch);
+    for (s32 y = min_y; y < max_y; ++y) {
+        g_blend_span((u32*)dest_row, source_row, max_x - min_x, c_alpha_8_8);
+        dest_row += buffer->pitch;
+        source_row += bitmap->width;
+    }
+}
+
+internal RenderGroup* allocate_render_group(MemoryArena* arena, u32 max_push_buffer_size) {
+    RenderGroup* result = push_struct(arena, RenderGroup);
+    result->push_buffer_base = (u8*)push_size(arena, max_push_buffer_size, 16);
+    result->max_push_buffer_size = max_push_buffer_size;
+    result->push_buffer_size = 0;
+    return result;
+}
+
+internal void clear_render_group(RenderGroup* group) {
+    group->push_buffer_size = 0;
+}
+
+#define push_render_element(group, type, entry_type) (type*)push_render_element_(group, sizeof(type), entry_type)
+internal void* push_render_element_(RenderGroup* group, u32 size, RenderGroupEntryType type) {
+    void* result = 0;
+
+    // keep headers 8 byte aligned so the bitmap pointers in entries are too
+    size = (size + sizeof(RenderGroupEntryHeader) + 7) & ~7;
+    if ((group->push_buffer_size + size) <= group->max_push_buffer_size) {
+        RenderGroupEntryHeader* header = (RenderGroupEntryHeader*)(group->push_buffer_base + group->push_buffer_size);
+        header->type = type;
+        header->size = size;
+        result = header + 1;
+        group->push_buffer_size += size;
+    } else {
+        INVALID_CODE_PATH;
+    }
+
+    return result;
+}
+
+internal void push_clear(RenderGroup* group, f32 r, f32 g, f32 b) {
+    RenderEntryClear* entry = push_render_element(group, RenderEntryClear, RGE_CLEAR);
+    if (entry) {
+        entry->r = r;
+        entry->g = g;
+        entry->b = b;
+    }
+}
+
+internal void push_rectangle(RenderGroup* group, V2 min, V2 max, f32 r, f32 g, f32 b) {
+    RenderEntryRectangle* entry = push_render_element(group, RenderEntryRectangle, RGE_RECTANGLE);
+    if (entry) {
+        entry->min = min;
+        entry->max = max;
+        entry->r = r;
+        entry->g = g;
+        entry->b = b;
+    }
+}
+
+// bitmaps that are still streaming in come through as NULL and are just skipped
+internal void push_bitmap(RenderGroup* group, LoadedBitmap* bitmap, f32 x, f32 y, f32 c_alpha = 1.0f) {
+    if (!bitmap) {
+        return;
+    }
+
+    RenderEntryBitmap* entry = push_render_element(group, RenderEntryBitmap, RGE_BITMAP);
+    if (entry) {
+        entry->bitmap = bitmap;
+        entry->p = v2(x, y);
+        entry->c_alpha = c_alpha;
+    }
+}
+
+internal void render_group_to_output(RenderGroup* group, GameOffscreenBuffer* output_target, Rect2i clip_rect) {
+    for (u32 base_address = 0; base_address < group->push_buffer_size;) {
+        RenderGroupEntryHeader* header = (RenderGroupEntryHeader*)(group->push_buffer_base + base_address);
+        void* data = header + 1;
+        base_address += header->size;
+
+        switch (header->type) {
+            case RGE_CLEAR:
+            {
+                RenderEntryClear* entry = (RenderEntryClear*)data;
+                draw_rectangle(output_target, v2(0.0f, 0.0f),
+                               v2((f32)output_target->width, (f32)output_target->height),
+                               entry->r, entry->g, entry->b, clip_rect);
+            } break;
+
+            case RGE_RECTANGLE:
+            {
+                RenderEntryRectangle* entry = (RenderEntryRectangle*)data;
+                draw_rectangle(output_target, entry->min, entry->max,
+                               entry->r, entry->g, entry->b, clip_rect);
+            } break;
+
+            case RGE_BITMAP:
+            {
+                RenderEntryBitmap* entry = (RenderEntryBitmap*)data;
+                draw_bitmap(output_target, entry->bitmap, entry->p.x, entry->p.y,
+                            entry->c_alpha, clip_rect);
+            } break;
+
+            default:
+            {
+                INVALID_CODE_PATH;
+            } break;
+        }
+    }
+}
+
+struct TileRenderWork {
+    RenderGroup* group;
+    GameOffscreenBuffer* output_target;
+    Rect2i clip_rect;
+};
+
+internal PLATFORM_WORK_QUEUE_CALLBACK(do_tile_render_work) {
+    TileRenderWork* work = (TileRenderWork*)data;
+    render_group_to_output(work->group, work->output_target, work->clip_rect);
+}
+
+// every tile walks the whole push buffer and only touches its own pixels, so tiles need no
+// locking, and the column edges sit on cache line edges of the output where it allows that
+internal void tiled_render_group_to_output(PlatformWorkQueue* render_queue,
+                                           RenderGroup* group, GameOffscreenBuffer* output_target) {
+    s32 const tile_count_x = 8;
+    s32 const tile_count_y = 8;
+    TileRenderWork work_array[tile_count_x * tile_count_y];
+
+    if (!render_queue) {
+        Rect2i clip_rect = {0, 0, output_target->width, output_target->height};
+        render_group_to_output(group, output_target, clip_rect);
+        return;
+    }
+
+    // Column edges go on 16 pixel, 64 byte, steps from the first cache line edge in the top row,
+    // so neighbouring columns don't write the same line. That holds on every row when the pitch
+    // is a multiple of 64 bytes, otherwise the lines on the edges are shared, which is only slower.
+    s32 edge_x[tile_count_x + 1];
+    s32 tile_width = (output_target->width + tile_count_x - 1) / tile_count_x;
+    s32 first_line_x = 0;
+    size_t line_offset = (size_t)output_target->memory & 63;
+    if (line_offset && (line_offset % output_target->bytes_per_pixel) == 0) {
+        first_line_x = (s32)((64 - line_offset) / output_target->bytes_per_pixel);
+    }
+    edge_x[0] = 0;
+    for (s32 tile_x = 1; tile_x < tile_count_x; ++tile_x) {
+        s32 x = first_line_x + ((tile_x * tile_width + 15) & ~15);
+        edge_x[tile_x] = min(x, output_target->width);
+    }
+    edge_x[tile_count_x] = output_target->width;
+    s32 tile_height = (output_target->height + tile_count_y - 1) / tile_count_y;
+
+    s32 work_count = 0;
+    for (s32 tile_y = 0; tile_y < tile_count_y; ++tile_y) {
+        for (s32 tile_x = 0; tile_x < tile_count_x; ++tile_x) {
+            Rect2i clip_rect;
+            clip_rect.min_x = edge_x[tile_x];
+            clip_rect.min_y = tile_y * tile_height;
+            clip_rect.max_x = edge_x[tile_x + 1];
+            clip_rect.max_y = min(clip_rect.min_y + tile_height, output_target->height);
+            if (clip_rect.min_x >= clip_rect.max_x || clip_rect.min_y >= clip_rect.max_y) continue;
+
+            TileRenderWork* work = work_array + work_count++;
+            work->group = group;
+            work->output_target = output_target;
+            work->clip_rect = clip_rect;
+
+            platform_add_entry(render_queue, do_tile_render_work, work);
+        }
+    }
+
+    platform_complete_all_work(render_queue);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+// top down, premultiplied 0xAARRGGBB, pitch == width
+struct LoadedBitmap {
+    s32 width;
+    s32 height;
+    s32 align_x;
+    s32 align_y;
+    u32* pixels;
+};
+
+// pixel space, max is exclusive
+struct Rect2i {
+    s32 min_x;
+    s32 min_y;
+    s32 max_x;
+    s32 max_y;
+};
+
+enum RenderGroupEntryType {
+    RGE_CLEAR,
+    RGE_RECTANGLE,
+    RGE_BITMAP,
+};
+
+struct RenderGroupEntryHeader {
+    RenderGroupEntryType type;
+    u32 size;
+};
+
+struct RenderEntryClear {
+    f32 r, g, b;
+};
+
+struct RenderEntryRectangle {
+    V2 min;
+    V2 max;
+    f32 r, g, b;
+};
+
+struct RenderEntryBitmap {
+    LoadedBitmap* bitmap;
+    V2 p;
+    f32 c_alpha;
+};
+
+// entries are in screen space, the game does the meters to pixels math when it pushes
+struct RenderGroup {
+    u32 max_push_buffer_size;
+    u32 push_buffer_size;
+    u8* push_buffer_base;
+};
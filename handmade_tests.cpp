@@ -0,0 +1,262 @@
+// Handmade Tests - offline tool, checks the game code against its reference paths and on
+// worlds the game never builds. The build runs it. Build it with HANDMADE_SLOW so the game's
+// own asserts and validation are live as well.
+#include "handmade.cpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !HANDMADE_SLOW
+#error handmade_tests needs HANDMADE_SLOW
+#endif
+
+typedef bool test_func();
+
+struct Test {
+    char* name;
+    test_func* run;
+};
+
+internal bool bits_equal(f32 a, f32 b) {
+    union { f32 f; u32 u; } a_bits, b_bits;
+    a_bits.f = a;
+    b_bits.f = b;
+    return a_bits.u == b_bits.u;
+}
+
+// the simd spans do the same integer math as the scalar one, so they have to match exactly
+internal bool test_blend_spans() {
+    CpuFeatures features = get_cpu_features();
+    u32 source[37];
+    u32 scalar_dest[37];
+    u32 simd_dest[37];
+    u32 c_alphas[] = {256, 192, 77, 0};
+
+    bool result = true;
+    u32 seed = 0x12345678;
+    for (u32 variant = 0; variant < 2; ++variant) {
+        blend_span_func* simd = variant == 0 ? blend_span_sse2 : blend_span_avx2;
+        if (variant == 0 && !features.sse2) continue;
+        if (variant == 1 && !features.avx2) continue;
+
+        for (s32 count = 1; count <= (s32)array_count(source); ++count) {
+            for (u32 c = 0; c < array_count(c_alphas); ++c) {
+                for (s32 i = 0; i < count; ++i) {
+                    seed = seed * 1664525 + 1013904223;
+                    u32 a = seed >> 24;
+                    source[i] = (a << 24) |
+                                ((((seed >> 16) & 0xFF) * a / 255) << 16) |
+                                ((((seed >> 8) & 0xFF) * a / 255) << 8) |
+                                ((((seed >> 0) & 0xFF) * a / 255) << 0);
+                    seed = seed * 1664525 + 1013904223;
+                    scalar_dest[i] = simd_dest[i] = seed;
+                }
+
+                blend_span_scalar(scalar_dest, source, count, c_alphas[c]);
+                simd(simd_dest, source, count, c_alphas[c]);
+
+                for (s32 i = 0; i < count; ++i) {
+                    if (scalar_dest[i] != simd_dest[i]) {
+                        result = false;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+// Shuffles a few thousand entities around a 3x3 block of chunks in a throwaway world, so
+// chunks hold hundreds of entities and most moves cross a chunk border.
+internal bool test_entity_chunk_moves() {
+    GameState* game_state = (GameState*)calloc(1, sizeof(GameState));
+    size_t world_arena_size = megabytes(16);
+    u8* world_memory = (u8*)calloc(1, world_arena_size);
+    if (!game_state || !world_memory) return false;
+
+    initialize_arena(&game_state->world_arena, world_arena_size, world_memory);
+    game_state->world = push_struct(&game_state->world_arena, World);
+    World* world = game_state->world;
+    initialize_world(world, &game_state->world_arena, 1.4f);
+    initialize_entity_templates(game_state);
+
+    add_low_entity(game_state, ET_NULL, NULL);
+
+    bool result = true;
+    RandomSeries series = random_seed(0x12345678);
+    for (u32 round = 0; result && round < 32; ++round) {
+        for (u32 entity_index = 1; entity_index < 4001; ++entity_index) {
+            u32 bits = random_next_u32(&series);
+
+            WorldPosition new_p = centered_chunk_point(10 + bits % 3, 10 + (bits >> 8) % 3, 0);
+            new_p.offset_x = (s32)((bits >> 16) & 0xFF) * (1 << (WORLD_CHUNK_SHIFT - 8)) - WORLD_CHUNK_HALF;
+            new_p.offset_y = (s32)((bits >> 24) & 0xFF) * (1 << (WORLD_CHUNK_SHIFT - 8)) - WORLD_CHUNK_HALF;
+
+            if (round == 0) {
+                add_low_entity(game_state, ET_WALL, &new_p);
+            } else {
+                LowEntity* low = get_low_entity(game_state, entity_index);
+                WorldPosition old_p = unpack_world_position(&low->p);
+                change_entity_location(game_state, entity_index, &old_p, &new_p);
+                low->p = pack_world_position(&new_p);
+            }
+        }
+
+        result = validate_chunk_refs(game_state);
+    }
+
+    free(world_memory);
+    free(game_state);
+    return result;
+}
+
+// Enough chunks for the hash to grow a few times. Every chunk has to be found again after the
+// moves, and the retired slot arrays have to be handed out as chunks instead of new pushes.
+internal bool test_chunk_hash_growth() {
+    World* world = (World*)calloc(1, sizeof(World));
+    size_t arena_size = megabytes(16);
+    u8* memory = (u8*)calloc(1, arena_size);
+    if (!world || !memory) return false;
+
+    MemoryArena arena;
+    initialize_arena(&arena, arena_size, memory);
+    initialize_world(world, &arena, 1.4f);
+    u32 first_slot_count = world->chunk_slot_count;
+
+    bool result = true;
+    s32 side = 100;
+    for (s32 y = 0; y < side; ++y) {
+        for (s32 x = 0; x < side; ++x) {
+            size_t used = arena.used;
+            bool had_free_chunk = world->first_free_chunk != 0;
+            WorldChunk* chunk = get_world_chunk(world, x, y, 0, &arena);
+            if (had_free_chunk && arena.used != used) {
+                result = false;
+            }
+            if (!chunk || chunk->chunk_x != x || chunk->chunk_y != y || chunk->chunk_z != 0) {
+                result = false;
+            }
+        }
+    }
+
+    for (s32 y = 0; y < side; ++y) {
+        for (s32 x = 0; x < side; ++x) {
+            WorldChunk* chunk = get_world_chunk(world, x, y, 0);
+            if (!chunk || chunk->chunk_x != x || chunk->chunk_y != y) {
+                result = false;
+            }
+        }
+    }
+
+    if (world->chunk_count != (u32)(side * side) || world->chunk_slot_count <= first_slot_count) {
+        result = false;
+    }
+
+    free(memory);
+    free(world);
+    return result;
+}
+
+// runs both integrations side by side over values that straddle the ground, including -0
+internal bool test_high_entity_sweeps() {
+    HighEntities* simd = (HighEntities*)calloc(2, sizeof(HighEntities));
+    if (!simd || ((size_t)simd & 15)) return false;
+    HighEntities* scalar = simd + 1;
+
+    u32 count = 1001;
+    RandomSeries series = random_seed(0x2545F491);
+    for (u32 i = 0; i < MAX_HIGH_ENTITY_COUNT; ++i) {
+        u32 bits = random_next_u32(&series);
+
+        f32 z = (f32)(bits & 0xFF) / 64.0f - 1.0f;
+        f32 dz = (f32)((bits >> 8) & 0xFF) / 16.0f - 8.0f;
+        if ((i % 7) == 0) z = -0.0f;
+        if ((i % 11) == 0) z = 0.0f;
+        simd->z[i] = scalar->z[i] = z;
+        simd->dz[i] = scalar->dz[i] = dz;
+    }
+
+    bool result = true;
+    for (u32 step = 0; result && step < 60; ++step) {
+        integrate_high_entity_z(simd, count, 1.0f / 60.0f);
+        integrate_high_entity_z_scalar(scalar, count, 1.0f / 60.0f);
+        for (u32 i = 0; i < count; ++i) {
+            if (!bits_equal(simd->z[i], scalar->z[i]) || !bits_equal(simd->dz[i], scalar->dz[i])) {
+                result = false;
+            }
+        }
+    }
+
+    free(simd);
+    return result;
+}
+
+// The kernel against the scalar loop on lots of small random batches, with zero deltas,
+// candidates touching the mover and duplicates so ties and t = 0 come up often.
+internal bool test_narrow_phase() {
+    CollisionCandidates* candidates = (CollisionCandidates*)calloc(1, sizeof(CollisionCandidates));
+    if (!candidates) return false;
+
+    bool result = true;
+    f32 radii[] = {0.0f, 0.5f, 0.75f, 1.2f, 1.4f};
+    RandomSeries series = random_seed(0x6A09E667);
+    for (u32 trial = 0; result && trial < 2000; ++trial) {
+        u32 trial_bits = random_next_u32(&series);
+
+        V2 delta = v2((f32)(s32)(trial_bits % 9) * 0.25f - 1.0f, (f32)(s32)((trial_bits >> 4) % 9) * 0.25f - 1.0f);
+        candidates->count = 0;
+        u32 count = (trial_bits >> 8) % 40;
+        for (u32 i = 0; i < count; ++i) {
+            u32 bits = random_next_u32(&series);
+
+            u32 c = candidates->count++;
+            if (c > 0 && (bits & 7) == 0) {
+                candidates->rel_x[c] = candidates->rel_x[c - 1];
+                candidates->rel_y[c] = candidates->rel_y[c - 1];
+                candidates->radius_x[c] = candidates->radius_x[c - 1];
+                candidates->radius_y[c] = candidates->radius_y[c - 1];
+            } else {
+                candidates->radius_x[c] = radii[(bits >> 3) % array_count(radii)];
+                candidates->radius_y[c] = radii[(bits >> 6) % array_count(radii)];
+                candidates->rel_x[c] = (f32)(s32)((bits >> 9) % 25) * 0.125f - 1.5f;
+                candidates->rel_y[c] = (f32)(s32)((bits >> 14) % 25) * 0.125f - 1.5f;
+                if ((bits >> 19) & 1) {
+                    // right on the wall
+                    candidates->rel_x[c] = -candidates->radius_x[c];
+                }
+            }
+            candidates->high_index[c] = c + 1;
+        }
+        pad_collision_candidates(candidates);
+
+        NarrowPhaseHit simd = find_earliest_hit(candidates, delta);
+        NarrowPhaseHit scalar = find_earliest_hit_scalar(candidates, delta);
+        result = bits_equal(simd.t, scalar.t) && simd.hit_index == scalar.hit_index;
+    }
+
+    free(candidates);
+    return result;
+}
+
+global Test tests[] = {
+    {"blend spans", test_blend_spans},
+    {"entity chunk moves", test_entity_chunk_moves},
+    {"chunk hash growth", test_chunk_hash_growth},
+    {"high entity sweeps", test_high_entity_sweeps},
+    {"narrow phase", test_narrow_phase},
+};
+
+int main(int argc, char** argv) {
+    u32 failed_count = 0;
+    for (u32 i = 0; i < array_count(tests); ++i) {
+        bool passed = tests[i].run();
+        printf("%-24s %s\n", tests[i].name, passed ? "ok" : "FAILED");
+        if (!passed) {
+            ++failed_count;
+        }
+    }
+
+    printf("%u of %u tests passed\n", (u32)array_count(tests) - failed_count, (u32)array_count(tests));
+    return failed_count ? 1 : 0;
+}
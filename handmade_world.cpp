@@ -1,28 +1,120 @@
 #include "handmade_world.h"
 
 #define WORLD_CHUNK_SAFE_MARGIN (INT32_MAX/64)
-#define WORLD_CHUNK_UNINITIALIZED INT32_MAX
-#define TILES_PER_CHUNK 16
 
-internal bool is_canonical(World* world, f32 tile_rel) {
-    // TODO fix float point funkiness, this will be replaced dont need it
-    return (tile_rel >= (-0.5f * world->chunk_side_in_meters)) &&
-           (tile_rel <= (0.5f * world->chunk_side_in_meters));
+internal bool is_canonical(s32 offset) {
+    return offset >= -WORLD_CHUNK_HALF && offset < WORLD_CHUNK_HALF;
 }
 
-internal bool is_canonical(World* world, V2 offset) {
-    return is_canonical(world, offset.x) && is_canonical(world, offset.y);
+internal bool is_canonical(WorldPosition* p) {
+    return is_canonical(p->offset_x) && is_canonical(p->offset_y);
 }
 
 internal bool are_in_same_chunk(World* world, WorldPosition* a, WorldPosition* b) {
-    assert(is_canonical(world, a->offset_));
-    assert(is_canonical(world, b->offset_));
+    assert(is_canonical(a));
+    assert(is_canonical(b));
     bool result = a->chunk_x == b->chunk_x &&
                   a->chunk_y == b->chunk_y &&
                   a->chunk_z == b->chunk_z;
     return result;
 }
 
+// murmur3 finalizer over the combined coords, rooms are laid out along diagonals so anything
+// linear in x, y and z piles them into the same few slots
+internal u32 hash_chunk_coords(s32 chunk_x, s32 chunk_y, s32 chunk_z) {
+    u32 hash = (u32)chunk_x * 0x8da6b343u;
+    hash ^= (u32)chunk_y * 0xd8163841u;
+    hash ^= (u32)chunk_z * 0xcb1ab31fu;
+
+    hash ^= hash >> 16;
+    hash *= 0x85ebca6bu;
+    hash ^= hash >> 13;
+    hash *= 0xc2b2ae35u;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+internal bool is_chunk_slot_used(WorldChunkSlot* slot) {
+    return slot->chunk || slot->swap_size;
+}
+
+internal bool is_chunk_paged_out(WorldChunkSlot* slot) {
+    return !slot->chunk && slot->swap_size;
+}
+
+internal WorldChunkSlot* find_chunk_slot(WorldChunkSlot* slots, u32 slot_count, s32 chunk_x, s32 chunk_y, s32 chunk_z,
+                                         u32* probe_count) {
+    u32 mask = slot_count - 1;
+    u32 slot_index = hash_chunk_coords(chunk_x, chunk_y, chunk_z) & mask;
+
+    // the load factor is capped below 1 so there is always an empty slot to stop on
+    for (u32 probe = 1;; ++probe) {
+        WorldChunkSlot* slot = slots + slot_index;
+        if (!is_chunk_slot_used(slot) ||
+            (slot->chunk_x == chunk_x && slot->chunk_y == chunk_y && slot->chunk_z == chunk_z)) {
+            *probe_count = probe;
+            return slot;
+        }
+        slot_index = (slot_index + 1) & mask;
+    }
+}
+
+internal void grow_chunk_hash(World* world, MemoryArena* arena) {
+    u32 new_slot_count = 2 * world->chunk_slot_count;
+    WorldChunkSlot* new_slots = push_array(arena, new_slot_count, WorldChunkSlot);
+    for (u32 i = 0; i < new_slot_count; ++i) {
+        new_slots[i] = {};
+    }
+
+    for (u32 i = 0; i < world->chunk_slot_count; ++i) {
+        WorldChunkSlot* old_slot = world->chunk_slots + i;
+        if (is_chunk_slot_used(old_slot)) {
+            u32 probe_count;
+            WorldChunkSlot* slot = find_chunk_slot(new_slots, new_slot_count,
+                                                   old_slot->chunk_x, old_slot->chunk_y, old_slot->chunk_z, &probe_count);
+            *slot = *old_slot;
+        }
+    }
+
+    // The arena can't take the old slots back and a later table never fits in them, but the
+    // table only grows because chunks keep being created, so they are cut up into chunks for
+    // the chunk free list. Snapshots then carry them as free chunks instead of a dead table.
+    assert(alignof(WorldChunk) <= alignof(WorldChunkSlot));
+    WorldChunk* old_chunks = (WorldChunk*)world->chunk_slots;
+    u32 old_chunk_count = (u32)((world->chunk_slot_count * sizeof(WorldChunkSlot)) / sizeof(WorldChunk));
+    for (u32 i = 0; i < old_chunk_count; ++i) {
+        old_chunks[i].next_free = world->first_free_chunk;
+        world->first_free_chunk = old_chunks + i;
+    }
+
+    world->chunk_slots = new_slots;
+    world->chunk_slot_count = new_slot_count;
+}
+
+internal WorldChunk* allocate_world_chunk(World* world, MemoryArena* arena) {
+    WorldChunk* result = world->first_free_chunk;
+    if (result) {
+        world->first_free_chunk = result->next_free;
+    } else {
+        result = push_struct(arena, WorldChunk);
+    }
+    return result;
+}
+
+internal void free_world_chunk(World* world, WorldChunk* chunk) {
+    // the blocks behind the first one go back to the block free list
+    WorldEntityBlock* block = chunk->first_block.next;
+    while (block) {
+        WorldEntityBlock* next = block->next;
+        block->next = world->first_free;
+        world->first_free = block;
+        block = next;
+    }
+
+    chunk->next_free = world->first_free_chunk;
+    world->first_free_chunk = chunk;
+}
+
 internal WorldChunk* get_world_chunk(World* world, s32 chunk_x, s32 chunk_y, s32 chunk_z,
                                           MemoryArena* arena = 0)
 {
@@ -33,89 +125,189 @@ internal WorldChunk* get_world_chunk(World* world, s32 chunk_x, s32 chunk_y, s32
     assert(chunk_y < WORLD_CHUNK_SAFE_MARGIN);
     assert(chunk_z < WORLD_CHUNK_SAFE_MARGIN);
 
-    u32 hash_value = 19*chunk_x + 7*chunk_y + 3*chunk_z;
-    u32 hash_slot = hash_value & (array_count(world->chunk_hash) - 1);
-    assert(hash_slot < array_count(world->chunk_hash));
-    WorldChunk* chunk = world->chunk_hash + hash_slot;
-
-    for(;;) {
-        // found
-        if (chunk_x == chunk->chunk_x &&
-            chunk_y == chunk->chunk_y &&
-            chunk_z == chunk->chunk_z)
-        {
-            return chunk;
-        }
+    u32 probe_count;
+    WorldChunkSlot* slot = find_chunk_slot(world->chunk_slots, world->chunk_slot_count,
+                                           chunk_x, chunk_y, chunk_z, &probe_count);
+    ++world->lookup_count;
+    world->lookup_probe_count += probe_count;
 
-        if (arena && !chunk->next_in_hash) {
-            if (chunk->chunk_x != WORLD_CHUNK_UNINITIALIZED) {
-                chunk->next_in_hash = push_struct(arena, WorldChunk);
-                chunk = chunk->next_in_hash;
+    // paging is driven from the camera, nothing should reach a chunk before it's paged back in
+    assert(!is_chunk_paged_out(slot));
+    if (slot->chunk || !arena) {
+        return slot->chunk;
+    }
+
+    // keep the load factor at or under a half, most lookups are misses from the camera sweep
+    // and those walk all the way to an empty slot
+    if (2 * (world->chunk_count + 1) > world->chunk_slot_count) {
+        grow_chunk_hash(world, arena);
+        slot = find_chunk_slot(world->chunk_slots, world->chunk_slot_count, chunk_x, chunk_y, chunk_z, &probe_count);
+    }
+
+    WorldChunk* chunk = allocate_world_chunk(world, arena);
+    chunk->chunk_x = chunk_x;
+    chunk->chunk_y = chunk_y;
+    chunk->chunk_z = chunk_z;
+    for (u32 row = 0; row < TILES_PER_CHUNK; ++row) {
+        chunk->wall_tile_rows[row] = 0;
+    }
+    chunk->generated = false;
+    chunk->room_count = 0;
+    chunk->last_near_frame = 0;
+    chunk->first_block.entity_count = 0;
+    chunk->first_block.next = 0;
+
+    slot->chunk_x = chunk_x;
+    slot->chunk_y = chunk_y;
+    slot->chunk_z = chunk_z;
+    slot->chunk = chunk;
+    ++world->chunk_count;
+    ++world->resident_chunk_count;
+
+    return chunk;
+}
+
+// probe lengths are measured from each chunk's home slot, 1 means it sits where it hashed
+internal WorldChunkHashStats get_world_chunk_hash_stats(World* world) {
+    WorldChunkHashStats result = {};
+    result.chunk_count = world->chunk_count;
+    result.slot_count = world->chunk_slot_count;
+    result.load_factor = (f32)world->chunk_count / (f32)world->chunk_slot_count;
+    result.lookup_count = world->lookup_count;
+    result.lookup_probe_count = world->lookup_probe_count;
+
+    u64 total_probe_length = 0;
+    u32 mask = world->chunk_slot_count - 1;
+    for (u32 slot_index = 0; slot_index < world->chunk_slot_count; ++slot_index) {
+        WorldChunkSlot* slot = world->chunk_slots + slot_index;
+        if (is_chunk_slot_used(slot)) {
+            u32 home = hash_chunk_coords(slot->chunk_x, slot->chunk_y, slot->chunk_z) & mask;
+            u32 probe_length = ((slot_index - home) & mask) + 1;
+            total_probe_length += probe_length;
+            if (probe_length > result.max_probe_length) {
+                result.max_probe_length = probe_length;
             }
-            chunk->chunk_x = chunk_x;
-            chunk->chunk_y = chunk_y;
-            chunk->chunk_z = chunk_z;
-            chunk->next_in_hash = 0;
-            return chunk;
-        } else if (!chunk->next_in_hash) {
-            return 0;
         }
+    }
 
-        chunk = chunk->next_in_hash;
+    if (world->chunk_count) {
+        result.average_probe_length = (f32)total_probe_length / (f32)world->chunk_count;
     }
+
+    return result;
 }
 
-internal void recanonicalize_coord(World* world, s32* tile, f32* tile_rel) {
-    s32 offset = round_f32_to_s32(*tile_rel / world->chunk_side_in_meters);
-    *tile += offset;
-    *tile_rel -= (offset * world->chunk_side_in_meters);
+// measured from the chunk's min corner the chunk is the high bits and the offset the low ones
+internal void recanonicalize_coord(s32* chunk, s32* offset) {
+    assert(*offset > -(1 << 30) && *offset < (1 << 30));
+    s32 from_min_corner = *offset + WORLD_CHUNK_HALF;
+    *chunk += from_min_corner >> WORLD_CHUNK_SHIFT;
+    *offset = (from_min_corner & WORLD_CHUNK_MASK) - WORLD_CHUNK_HALF;
 
-    assert(is_canonical(world, *tile_rel));
+    assert(is_canonical(*offset));
 }
 
+internal s32 meters_to_units(World* world, f32 meters) {
+    return round_f32_to_s32(meters * world->units_per_meter);
+}
+
+// the offset is rounded to the nearest unit, a unit is about a third of a millimeter
 internal WorldPosition map_to_chunk_space(World* world, WorldPosition base_pos, V2 offset) {
     WorldPosition result = base_pos;
 
-    result.offset_ += offset;
-    recanonicalize_coord(world, &result.chunk_x, &result.offset_.x);
-    recanonicalize_coord(world, &result.chunk_y, &result.offset_.y);
+    result.offset_x += meters_to_units(world, offset.x);
+    result.offset_y += meters_to_units(world, offset.y);
+    recanonicalize_coord(&result.chunk_x, &result.offset_x);
+    recanonicalize_coord(&result.chunk_y, &result.offset_y);
 
     return result;
 }
 
-internal void initialize_world(World* world, f32 tile_side_in_meters) {
+// the tile whose center is nearest, tiles are centered on whole tiles from a chunk's center
+internal s32 get_abs_tile(s32 chunk, s32 offset) {
+    return chunk * TILES_PER_CHUNK + ((offset + (1 << (WORLD_TILE_SHIFT - 1))) >> WORLD_TILE_SHIFT);
+}
+
+internal void initialize_world(World* world, MemoryArena* arena, f32 tile_side_in_meters) {
     world->tile_side_in_meters = tile_side_in_meters;
     world->chunk_side_in_meters = (f32)TILES_PER_CHUNK * tile_side_in_meters;
+    world->meters_per_unit = tile_side_in_meters / (f32)(1 << WORLD_TILE_SHIFT);
+    world->units_per_meter = (f32)(1 << WORLD_TILE_SHIFT) / tile_side_in_meters;
     world->first_free = 0;
-
-    for (u32 i = 0; i < array_count(world->chunk_hash); ++i) {
-        world->chunk_hash[i].chunk_x = WORLD_CHUNK_UNINITIALIZED;
-        world->chunk_hash[i].first_block.entity_count = 0;
+    world->first_free_chunk = 0;
+    world->resident_chunk_count = 0;
+
+    world->chunk_count = 0;
+    world->chunk_slot_count = 4096;
+    world->chunk_slots = push_array(arena, world->chunk_slot_count, WorldChunkSlot);
+    for (u32 i = 0; i < world->chunk_slot_count; ++i) {
+        world->chunk_slots[i] = {};
     }
+    world->lookup_count = 0;
+    world->lookup_probe_count = 0;
 }
 
 internal WorldPosition chunk_position_from_tile_position(World* world, s32 abs_tile_x, s32 abs_tile_y, s32 abs_tile_z) {
     WorldPosition result = {};
 
-    result.chunk_x = abs_tile_x / TILES_PER_CHUNK;
-    result.chunk_y = abs_tile_y / TILES_PER_CHUNK;
-    result.chunk_z = abs_tile_z / TILES_PER_CHUNK;
+    result.chunk_x = abs_tile_x >> TILE_CHUNK_SHIFT;
+    result.chunk_y = abs_tile_y >> TILE_CHUNK_SHIFT;
+    result.chunk_z = abs_tile_z >> TILE_CHUNK_SHIFT;
 
-    result.offset_.x = (f32)(abs_tile_x - (result.chunk_x * TILES_PER_CHUNK)) * world->tile_side_in_meters;
-    result.offset_.y = (f32)(abs_tile_y - (result.chunk_y * TILES_PER_CHUNK)) * world->tile_side_in_meters;
+    result.offset_x = (abs_tile_x & TILE_CHUNK_MASK) << WORLD_TILE_SHIFT;
+    result.offset_y = (abs_tile_y & TILE_CHUNK_MASK) << WORLD_TILE_SHIFT;
+    recanonicalize_coord(&result.chunk_x, &result.offset_x);
+    recanonicalize_coord(&result.chunk_y, &result.offset_y);
     // TODO move ot 3d Z
 
     return result;
 }
 
+internal void set_wall_tile(World* world, MemoryArena* arena, s32 abs_tile_x, s32 abs_tile_y, s32 abs_tile_z) {
+    WorldChunk* chunk = get_world_chunk(world, abs_tile_x >> TILE_CHUNK_SHIFT, abs_tile_y >> TILE_CHUNK_SHIFT,
+                                        abs_tile_z >> TILE_CHUNK_SHIFT, arena);
+    chunk->wall_tile_rows[abs_tile_y & TILE_CHUNK_MASK] |= (u16)(1 << (abs_tile_x & TILE_CHUNK_MASK));
+}
+
+// Safe to call from several threads at once, as long as the chunk is already there.
+internal void set_wall_tile_in_chunk(WorldChunk* chunk, s32 abs_tile_x, s32 abs_tile_y) {
+    assert(chunk->chunk_x == abs_tile_x >> TILE_CHUNK_SHIFT && chunk->chunk_y == abs_tile_y >> TILE_CHUNK_SHIFT);
+    atomic_or_u16((u16 volatile*)chunk->wall_tile_rows + (abs_tile_y & TILE_CHUNK_MASK), (u16)(1 << (abs_tile_x & TILE_CHUNK_MASK)));
+}
+
+// Bit i is the wall tile at abs_tile_x + i, for up to 31 tiles of one row. The top bit is always
+// clear so callers can count a run of set bits by looking for the next clear one.
+internal u32 get_wall_tile_bits(World* world, s32 abs_tile_x, s32 abs_tile_y, s32 abs_tile_z, u32 tile_count) {
+    assert(tile_count < 32);
+
+    u32 result = 0;
+    u32 done = 0;
+    while (done < tile_count) {
+        s32 tile_x = abs_tile_x + (s32)done;
+        u32 tile_in_chunk_x = tile_x & TILE_CHUNK_MASK;
+        u32 count = min(TILES_PER_CHUNK - tile_in_chunk_x, tile_count - done);
+
+        WorldChunk* chunk = get_world_chunk(world, tile_x >> TILE_CHUNK_SHIFT, abs_tile_y >> TILE_CHUNK_SHIFT,
+                                            abs_tile_z >> TILE_CHUNK_SHIFT);
+        if (chunk) {
+            u32 row = chunk->wall_tile_rows[abs_tile_y & TILE_CHUNK_MASK];
+            result |= ((row >> tile_in_chunk_x) & ((1u << count) - 1)) << done;
+        }
+        done += count;
+    }
+
+    return result;
+}
+
+// exact in units however far apart the chunks are, only the conversion to meters rounds
 internal WorldDifference subtract(World* world, WorldPosition* a, WorldPosition* b) {
     WorldDifference result;
 
-    V2 d_tile_xy = { (f32)a->chunk_x - (f32)b->chunk_x,
-                     (f32)a->chunk_y - (f32)b->chunk_y };
+    s64 d_x = ((s64)a->chunk_x - b->chunk_x) * (1 << WORLD_CHUNK_SHIFT) + ((s64)a->offset_x - b->offset_x);
+    s64 d_y = ((s64)a->chunk_y - b->chunk_y) * (1 << WORLD_CHUNK_SHIFT) + ((s64)a->offset_y - b->offset_y);
     f32 d_tile_z = (f32)a->chunk_z - (f32)b->chunk_z;
 
-    result.d_xy = (world->chunk_side_in_meters * d_tile_xy) + (a->offset_ - b->offset_);
+    result.d_xy = world->meters_per_unit * v2((f32)d_x, (f32)d_y);
     result.d_z = (world->chunk_side_in_meters * d_tile_z);
 
     return result;
@@ -129,36 +321,61 @@ internal WorldPosition centered_chunk_point(u32 chunk_x, u32 chunk_y, u32 chunk_
     return result;
 }
 
-internal void change_entity_location(MemoryArena* arena, World* world, u32 low_entity_index,
-                                            WorldPosition* old_p, WorldPosition* new_p)
+internal void set_chunk_ref(GameState* game_state, WorldEntityBlock* block, u32 index_in_block) {
+    LowEntityCold* cold = get_low_entity_cold(game_state, block->low_entity_index[index_in_block]);
+    assert(cold);
+    cold->block = block;
+    cold->index_in_block = index_in_block;
+}
+
+// entries only ever move in whole blocks or one at a time out of the first block,
+// so keeping the back references right is at most a block's worth of writes
+internal void fix_block_chunk_refs(GameState* game_state, WorldEntityBlock* block) {
+    for (u32 i = 0; i < block->entity_count; ++i) {
+        set_chunk_ref(game_state, block, i);
+    }
+}
+
+internal void change_entity_location(GameState* game_state, u32 low_entity_index,
+                                     WorldPosition* old_p, WorldPosition* new_p)
 {
+    World* world = game_state->world;
+    MemoryArena* arena = &game_state->world_arena;
+
     if (old_p && are_in_same_chunk(world, old_p, new_p)) return;
 
+    LowEntityCold* cold = get_low_entity_cold(game_state, low_entity_index);
+    assert(cold);
+
     if (old_p) {
         WorldChunk* chunk = get_world_chunk(world, old_p->chunk_x, old_p->chunk_y, old_p->chunk_z);
         assert(chunk);
-        if (chunk) {
-            WorldEntityBlock* first_block = &chunk->first_block;
-            for (WorldEntityBlock* block = first_block; block; block = block->next) {
-                for (u32 i = 0; i < block->entity_count; ++i) {
-                    if (block->low_entity_index[i] == low_entity_index) {
-                        assert(first_block->entity_count > 0);
-                        block->low_entity_index[i] = first_block->low_entity_index[--first_block->entity_count];
-                        if (first_block->entity_count == 0 && first_block->next) {
-                            WorldEntityBlock* next_block = first_block->next;
-                            *first_block = *next_block;
-
-                            next_block->next = world->first_free;
-                            world->first_free = next_block;
-                        }
-                        goto end_loops;
-                    }
-                }
-            }
+
+        WorldEntityBlock* block = cold->block;
+        u32 index_in_block = cold->index_in_block;
+        assert(block && block->low_entity_index[index_in_block] == low_entity_index);
+
+        // swap remove with the last entry of the first block, which is the only partial one
+        WorldEntityBlock* first_block = &chunk->first_block;
+        assert(first_block->entity_count > 0);
+        block->low_entity_index[index_in_block] = first_block->low_entity_index[--first_block->entity_count];
+        if (block != first_block || index_in_block != first_block->entity_count) {
+            set_chunk_ref(game_state, block, index_in_block);
         }
+
+        if (first_block->entity_count == 0 && first_block->next) {
+            WorldEntityBlock* next_block = first_block->next;
+            *first_block = *next_block;
+            fix_block_chunk_refs(game_state, first_block);
+
+            next_block->next = world->first_free;
+            world->first_free = next_block;
+        }
+
+        cold->block = 0;
+        cold->index_in_block = 0;
     }
 
-    end_loops:
     WorldChunk* chunk = get_world_chunk(world, new_p->chunk_x, new_p->chunk_y, new_p->chunk_z, arena);
     assert(chunk);
 
@@ -171,14 +388,14 @@ internal void change_entity_location(MemoryArena* arena, World* world, u32 low_e
             old_block = push_struct(arena, WorldEntityBlock);
         }
         *old_block = *block;
+        fix_block_chunk_refs(game_state, old_block);
         block->next = old_block;
         block->entity_count = 0;
     }
 
     assert(block->entity_count < array_count(block->low_entity_index));
-    block->low_entity_index[block->entity_count++] = low_entity_index;
+    u32 index_in_block = block->entity_count++;
+    block->low_entity_index[index_in_block] = low_entity_index;
+    cold->block = block;
+    cold->index_in_block = index_in_block;
 }
-
-
-
-
@@ -1,28 +1,91 @@
 #pragma once
 
+#define TILE_CHUNK_SHIFT 4
+#define TILE_CHUNK_MASK ((1 << TILE_CHUNK_SHIFT) - 1)
+#define TILES_PER_CHUNK (1 << TILE_CHUNK_SHIFT)
+
+// Offsets inside a chunk are fixed point with 1 << WORLD_TILE_SHIFT units to a tile, so
+// canonicalizing is shifts and masks and a position is as exact far out as at the origin.
+#define WORLD_TILE_SHIFT 12
+#define WORLD_CHUNK_SHIFT (WORLD_TILE_SHIFT + TILE_CHUNK_SHIFT)
+#define WORLD_CHUNK_MASK ((1 << WORLD_CHUNK_SHIFT) - 1)
+#define WORLD_CHUNK_HALF (1 << (WORLD_CHUNK_SHIFT - 1))
+
 struct WorldEntityBlock {
     u32 entity_count;
     u32 low_entity_index[16];
     WorldEntityBlock* next;
 };
 
+// 16x16 tiles overlap at most 2 by 3 of the generator's 17x9 rooms
+#define MAX_ROOMS_PER_CHUNK 6
+
+struct WorldRoom;
+
 struct WorldChunk {
     s32 chunk_x;
     s32 chunk_y;
     s32 chunk_z;
 
+    // solid tiles, bit x of row y. This is what walls collide with, the wall entities are
+    // only there to be drawn. World generation fills these in first and then adds the wall
+    // entities as a few merged rectangles instead of one per tile
+    u16 wall_tile_rows[TILES_PER_CHUNK];
+
+    // Rooms overlapping the chunk, added as the generator lays them out. A chunk isn't
+    // generated until the sim region first touches it, then the walls of all of these go in.
+    bool generated;
+    u32 room_count;
+    WorldRoom* rooms[MAX_ROOMS_PER_CHUNK];
+
+    // last frame the chunk was within the page out radius of the camera
+    u32 last_near_frame;
+    WorldChunk* next_free;
+
     WorldEntityBlock first_block;
+};
 
-    WorldChunk* next_in_hash;
+// The coords are duplicated here so probing never has to touch the chunk itself. A chunk
+// that was paged out keeps its slot with no chunk and a non zero swap_size, and once a chunk
+// has been written its extent in the swap file stays with the slot to be reused.
+struct WorldChunkSlot {
+    s32 chunk_x;
+    s32 chunk_y;
+    s32 chunk_z;
+    u32 swap_size;
+    WorldChunk* chunk;
+    u64 swap_offset;
+};
+
+struct WorldChunkHashStats {
+    u32 chunk_count;
+    u32 slot_count;
+    f32 load_factor;
+    f32 average_probe_length;
+    u32 max_probe_length;
+
+    u64 lookup_count;
+    u64 lookup_probe_count;
 };
 
 struct World {
     f32 tile_side_in_meters;
     f32 chunk_side_in_meters;
+    f32 meters_per_unit;
+    f32 units_per_meter;
 
     WorldEntityBlock* first_free;
+    WorldChunk* first_free_chunk;
+
+    // open addressing with linear probing, slot_count is a power of two and an empty slot has
+    // no chunk. Only the slots move when the table grows, callers can hold on to chunks.
+    u32 chunk_slot_count;
+    u32 chunk_count;
+    u32 resident_chunk_count;
+    WorldChunkSlot* chunk_slots;
 
-    WorldChunk chunk_hash[4096];
+    u64 lookup_count;
+    u64 lookup_probe_count;
 };
 
 struct WorldDifference {
@@ -35,6 +98,8 @@ struct WorldPosition {
     s32 chunk_y;
     s32 chunk_z;
 
-    // NOTE this is relative to the chunk center
-    V2 offset_;
+    // NOTE this is relative to the chunk center, canonical offsets are in
+    // [-WORLD_CHUNK_HALF, WORLD_CHUNK_HALF)
+    s32 offset_x;
+    s32 offset_y;
 };
@@ -0,0 +1,732 @@
+// Linux Code - headless platform layer, renders into memory and reports frame timings
+#include "handmade_platform.h"
+
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <x86intrin.h>
+
+#include "linux_work_queue.cpp"
+
+enum LinuxHugePages {
+    LHP_OFF,
+    // madvise, the kernel backs whatever 2 MB regions get touched when it can
+    LHP_TRANSPARENT,
+    // MAP_HUGETLB out of the reserved pool, falls back to transparent if the pool is too small
+    LHP_EXPLICIT,
+};
+
+// one resident set sample a second at 30 hz, only taken with --memory
+#define LINUX_RSS_SAMPLE_FRAMES 30
+
+// the default huge page size on x86-64, what MAP_HUGETLB gets without a size flag
+#define LINUX_HUGE_PAGE_SIZE megabytes(2)
+
+#define LINUX_STATE_FILENAME_COUNT 4096
+struct LinuxState {
+    u64 total_size;
+    u64 permanent_size;
+    void* game_memory_block;
+    // what the permanent storage actually got, which can be less than was asked for
+    LinuxHugePages huge_pages;
+
+    char exe_filename[LINUX_STATE_FILENAME_COUNT];
+    char* one_past_last_exe_filename_slash;
+};
+
+struct BenchmarkOptions {
+    u32 frame_count;
+    bool uncapped;
+    char* dump_filename;
+    // 0 means one less than the core count
+    u32 worker_count;
+    // loaded at startup if it is there, written after the last frame
+    char* snapshot_filename;
+    bool print_memory;
+    LinuxHugePages huge_pages;
+};
+
+DEBUG_PLATFORM_READ_ENTIRE_FILE(debug_platform_read_entire_file) {
+    DebugReadFileResult result = {};
+
+    int file_handle = open(filename, O_RDONLY);
+    if (file_handle == -1) {
+        fprintf(stderr, "could not open %s\n", filename);
+        assert(false);
+        exit(1);
+    }
+
+    struct stat file_stat;
+    if (fstat(file_handle, &file_stat) == -1) {
+        assert(false);
+        exit(1);
+    }
+
+    result.contents_size = safe_truncate_uint64(file_stat.st_size);
+    result.contents = malloc(result.contents_size);
+    if (!result.contents) {
+        assert(false);
+        exit(1);
+    }
+
+    u8* dest = (u8*)result.contents;
+    u32 bytes_to_read = result.contents_size;
+    while (bytes_to_read) {
+        ssize_t bytes_read = read(file_handle, dest, bytes_to_read);
+        if (bytes_read <= 0) {
+            assert(false);
+            exit(1);
+        }
+        dest += bytes_read;
+        bytes_to_read -= (u32)bytes_read;
+    }
+
+    close(file_handle);
+
+    return result;
+}
+
+DEBUG_PLATFORM_FREE_FILE_MEMORY(debug_platform_free_file_memory) {
+    free(memory);
+}
+
+DEBUG_PLATFORM_WRITE_ENTIRE_FILE(debug_platform_write_entire_file) {
+    bool result = false;
+
+    int file_handle = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_handle == -1) {
+        assert(false);
+        exit(1);
+    }
+
+    ssize_t bytes_written = write(file_handle, memory, memory_size);
+    result = (bytes_written == (ssize_t)memory_size);
+    assert(result);
+
+    close(file_handle);
+    return result;
+}
+
+PLATFORM_MAP_FILE(linux_map_file) {
+    PlatformMappedFile result = {};
+
+    int file_handle = open(filename, O_RDONLY);
+    if (file_handle == -1) {
+        return result;
+    }
+
+    struct stat file_status;
+    if (fstat(file_handle, &file_status) == 0 && file_status.st_size > 0) {
+        void* contents = mmap(0, file_status.st_size, PROT_READ, MAP_PRIVATE, file_handle, 0);
+        if (contents != MAP_FAILED) {
+            result.size = file_status.st_size;
+            result.contents = contents;
+        }
+    }
+
+    // the mapping keeps its own reference to the file
+    close(file_handle);
+    return result;
+}
+
+PLATFORM_UNMAP_FILE(linux_unmap_file) {
+    if (file->contents) {
+        munmap(file->contents, file->size);
+    }
+    *file = {};
+}
+
+PLATFORM_WRITE_ENTIRE_FILE(linux_write_entire_file) {
+    char temp_filename[4096];
+    if (snprintf(temp_filename, sizeof(temp_filename), "%s.tmp", filename) >= (int)sizeof(temp_filename)) {
+        return false;
+    }
+
+    int file_handle = open(temp_filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file_handle == -1) {
+        return false;
+    }
+
+    bool result = true;
+    u8* bytes = (u8*)memory;
+    while (result && size) {
+        ssize_t bytes_written = write(file_handle, bytes, size);
+        if (bytes_written <= 0) {
+            result = false;
+        } else {
+            bytes += bytes_written;
+            size -= bytes_written;
+        }
+    }
+    close(file_handle);
+
+    // rename replaces the old file in one step, so a reader sees either one or the other
+    if (result) {
+        result = rename(temp_filename, filename) == 0;
+    }
+    if (!result) {
+        unlink(temp_filename);
+    }
+
+    return result;
+}
+
+PLATFORM_OPEN_SWAP_FILE(linux_open_swap_file) {
+    PlatformFileHandle result = {};
+
+    int file_handle = open(filename, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (file_handle != -1) {
+        // nobody else needs to see it, the space comes back when the process exits
+        unlink(filename);
+        result.no_errors = true;
+        result.platform = (void*)(intptr_t)file_handle;
+    }
+
+    return result;
+}
+
+PLATFORM_READ_DATA_FROM_FILE(linux_read_data_from_file) {
+    if (!handle->no_errors) return false;
+
+    int file_handle = (int)(intptr_t)handle->platform;
+    u8* dest_bytes = (u8*)dest;
+    while (size) {
+        ssize_t bytes_read = pread(file_handle, dest_bytes, size, offset);
+        if (bytes_read <= 0) {
+            handle->no_errors = false;
+            return false;
+        }
+        dest_bytes += bytes_read;
+        offset += bytes_read;
+        size -= bytes_read;
+    }
+
+    return true;
+}
+
+PLATFORM_WRITE_DATA_TO_FILE(linux_write_data_to_file) {
+    if (!handle->no_errors) return false;
+
+    int file_handle = (int)(intptr_t)handle->platform;
+    u8* source_bytes = (u8*)source;
+    while (size) {
+        ssize_t bytes_written = pwrite(file_handle, source_bytes, size, offset);
+        if (bytes_written <= 0) {
+            handle->no_errors = false;
+            return false;
+        }
+        source_bytes += bytes_written;
+        offset += bytes_written;
+        size -= bytes_written;
+    }
+
+    return true;
+}
+
+internal void get_exe_filename(LinuxState* state) {
+    ssize_t size_of_filename = readlink("/proc/self/exe", state->exe_filename, sizeof(state->exe_filename) - 1);
+    if (size_of_filename < 0) {
+        size_of_filename = 0;
+    }
+    state->exe_filename[size_of_filename] = 0;
+
+    state->one_past_last_exe_filename_slash = state->exe_filename;
+    for (char* scan = state->exe_filename; *scan; ++scan) {
+        if (*scan == '/') {
+            state->one_past_last_exe_filename_slash = scan + 1;
+        }
+    }
+}
+
+internal void build_exe_path_filename(LinuxState* state, char* filename, int dest_count, char* dest) {
+    snprintf(dest, dest_count, "%.*s%s",
+             (int)(state->one_past_last_exe_filename_slash - state->exe_filename), state->exe_filename,
+             filename);
+}
+
+struct GameCode {
+    void* game_code_so;
+    game_update_and_render_func* update_and_render;
+    game_get_sound_samples_func* get_sound_samples;
+    // optional, only internal builds export it
+    debug_game_get_memory_stats_func* get_memory_stats;
+    bool is_valid;
+};
+
+internal GameCode load_game_code(char* source_so_name) {
+    GameCode result = {};
+
+    result.game_code_so = dlopen(source_so_name, RTLD_NOW | RTLD_LOCAL);
+    if (result.game_code_so) {
+        result.update_and_render = (game_update_and_render_func*)dlsym(result.game_code_so, "game_update_and_render");
+        result.get_sound_samples = (game_get_sound_samples_func*)dlsym(result.game_code_so, "game_get_sound_samples");
+        result.get_memory_stats = (debug_game_get_memory_stats_func*)dlsym(result.game_code_so, "debug_game_get_memory_stats");
+        result.is_valid = result.update_and_render && result.get_sound_samples;
+    } else {
+        fprintf(stderr, "dlopen failed: %s\n", dlerror());
+    }
+
+    if (!result.is_valid) {
+        result.update_and_render = 0;
+        result.get_sound_samples = 0;
+        result.get_memory_stats = 0;
+    }
+
+    return result;
+}
+
+internal void print_memory_stats(GameCode* game, GameMemory* game_memory) {
+    if (!game->get_memory_stats) {
+        printf("memory:          no telemetry in this build\n");
+        return;
+    }
+
+    DebugMemoryStats stats;
+    game->get_memory_stats(game_memory, &stats);
+
+    f64 mb = 1024.0 * 1024.0;
+    printf("permanent peak:  %.2f of %.2f MB\n", stats.permanent_storage_peak / mb, game_memory->permanent_storage_size / mb);
+    printf("transient peak:  %.2f of %.2f MB\n", stats.transient_storage_peak / mb, game_memory->transient_storage_size / mb);
+    for (u32 i = 0; i < stats.arena_count; ++i) {
+        DebugArenaStats* arena = stats.arenas + i;
+        printf("arena %-10s used %.3f peak %.3f of %.3f MB, %llu pushes, last frame %u pushes %llu bytes\n",
+               arena->name, arena->used / mb, arena->peak_used / mb, arena->size / mb,
+               (unsigned long long)arena->push_count, arena->frame_push_count,
+               (unsigned long long)arena->frame_pushed_size);
+    }
+    for (u32 i = 0; i < stats.call_site_count; ++i) {
+        DebugArenaCallSite* site = stats.call_sites + i;
+        printf("  %-10s %-32s %8llu pushes %12.3f MB\n", site->arena_name, site->location,
+               (unsigned long long)site->push_count, site->pushed_size / mb);
+    }
+    f64 lookup_probes = stats.chunk_lookup_count ? (f64)stats.chunk_lookup_probe_count / (f64)stats.chunk_lookup_count : 0.0;
+    printf("chunk hash:      %u chunks in %u slots, load %.3f, probe length avg %.3f max %u, %llu lookups avg %.3f probes\n",
+           stats.chunk_count, stats.chunk_slot_count, stats.chunk_load_factor, stats.chunk_average_probe_length,
+           stats.chunk_max_probe_length, (unsigned long long)stats.chunk_lookup_count, lookup_probes);
+}
+
+// Only the address space is reserved, pages are committed as the game first touches them, so
+// the part of the transient storage that is never used costs nothing. The permanent storage
+// holds GameState and the world arena, which is what the entity passes sweep, so that is
+// where huge pages go. The transient storage stays on small pages and commits only what it
+// touches.
+internal bool linux_allocate_game_memory(LinuxState* state, void* base_address, u64 permanent_size,
+                                         u64 transient_size, LinuxHugePages huge_pages) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    if (base_address) {
+        // a plain hint lets the kernel put the block anywhere
+        flags |= MAP_FIXED_NOREPLACE;
+    }
+
+    state->permanent_size = permanent_size;
+    state->total_size = permanent_size + transient_size;
+
+    // hugetlb mappings have to start on a huge page, so without a base address the block is
+    // reserved with a huge page of slack and the ends trimmed off to align it
+    u64 slack = base_address ? 0 : LINUX_HUGE_PAGE_SIZE;
+    u8* reserved = (u8*)mmap(base_address, state->total_size + slack, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (reserved == MAP_FAILED) {
+        state->game_memory_block = 0;
+        return false;
+    }
+    if (base_address && reserved != base_address) {
+        // kernels before 4.17 don't know MAP_FIXED_NOREPLACE and take the address as a hint
+        munmap(reserved, state->total_size);
+        state->game_memory_block = 0;
+        return false;
+    }
+    if (slack) {
+        u8* aligned = (u8*)(((size_t)reserved + LINUX_HUGE_PAGE_SIZE - 1) & ~(size_t)(LINUX_HUGE_PAGE_SIZE - 1));
+        if (aligned > reserved) {
+            munmap(reserved, aligned - reserved);
+        }
+        u64 tail_size = (reserved + slack) - aligned;
+        if (tail_size) {
+            munmap(aligned + state->total_size, tail_size);
+        }
+        reserved = aligned;
+    }
+    state->game_memory_block = reserved;
+
+    state->huge_pages = LHP_OFF;
+    if (huge_pages == LHP_EXPLICIT) {
+        // hugetlb pages are reserved when they are mapped, so a pool that is too small fails
+        // here and not with a SIGBUS later
+        void* permanent = mmap(state->game_memory_block, permanent_size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB, -1, 0);
+        if (permanent == state->game_memory_block) {
+            state->huge_pages = LHP_EXPLICIT;
+        } else {
+            // a failed MAP_FIXED can leave the range unmapped, so it is mapped again
+            permanent = mmap(state->game_memory_block, permanent_size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+            if (permanent == MAP_FAILED) {
+                munmap(state->game_memory_block, state->total_size);
+                state->game_memory_block = 0;
+                return false;
+            }
+        }
+    }
+    if (huge_pages != LHP_OFF && state->huge_pages == LHP_OFF) {
+        if (madvise(state->game_memory_block, permanent_size, MADV_HUGEPAGE) == 0) {
+            state->huge_pages = LHP_TRANSPARENT;
+        }
+    }
+
+    return true;
+}
+
+// The resident set of the whole process, from /proc/self/statm.
+internal u64 linux_get_resident_size() {
+    u64 result = 0;
+
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (file) {
+        unsigned long long size_pages = 0;
+        unsigned long long resident_pages = 0;
+        if (fscanf(file, "%llu %llu", &size_pages, &resident_pages) == 2) {
+            result = resident_pages * (u64)sysconf(_SC_PAGESIZE);
+        }
+        fclose(file);
+    }
+
+    return result;
+}
+
+// How much of a range of the game memory block has been committed.
+internal u64 linux_get_resident_size(void* memory, u64 size) {
+    u64 page_size = (u64)sysconf(_SC_PAGESIZE);
+    u64 page_count = (size + page_size - 1) / page_size;
+    unsigned char* resident = (unsigned char*)malloc(page_count);
+    if (!resident) return 0;
+
+    u64 result = 0;
+    if (mincore(memory, size, resident) == 0) {
+        for (u64 page_index = 0; page_index < page_count; ++page_index) {
+            if (resident[page_index] & 1) {
+                result += page_size;
+            }
+        }
+    }
+    free(resident);
+
+    return result;
+}
+
+// Anonymous memory the kernel has backed with transparent huge pages, from smaps_rollup.
+internal u64 linux_get_anon_huge_page_size() {
+    u64 result = 0;
+
+    FILE* file = fopen("/proc/self/smaps_rollup", "r");
+    if (file) {
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            unsigned long long kilobytes = 0;
+            if (sscanf(line, "AnonHugePages: %llu kB", &kilobytes) == 1) {
+                result = kilobytes * 1024;
+                break;
+            }
+        }
+        fclose(file);
+    }
+
+    return result;
+}
+
+internal char* get_huge_pages_name(LinuxHugePages huge_pages) {
+    char* result = "off";
+    if (huge_pages == LHP_TRANSPARENT) {
+        result = "transparent";
+    } else if (huge_pages == LHP_EXPLICIT) {
+        result = "explicit";
+    }
+    return result;
+}
+
+internal void print_resident_memory(LinuxState* state, LinuxHugePages requested_huge_pages,
+                                    u64* rss_samples, u32 rss_sample_count) {
+    f64 mb = 1024.0 * 1024.0;
+    u8* block = (u8*)state->game_memory_block;
+    u64 transient_size = state->total_size - state->permanent_size;
+
+    printf("huge pages:      %s for the permanent storage (asked for %s)\n",
+           get_huge_pages_name(state->huge_pages), get_huge_pages_name(requested_huge_pages));
+    printf("resident:        permanent %.2f of %.2f MB, transient %.2f of %.2f MB, %.2f MB in transparent huge pages\n",
+           linux_get_resident_size(block, state->permanent_size) / mb, state->permanent_size / mb,
+           linux_get_resident_size(block + state->permanent_size, transient_size) / mb, transient_size / mb,
+           linux_get_anon_huge_page_size() / mb);
+    for (u32 i = 0; i < rss_sample_count; ++i) {
+        printf("rss frame %-6u %.2f MB\n", i * LINUX_RSS_SAMPLE_FRAMES, rss_samples[i] / mb);
+    }
+}
+
+internal u64 get_wall_clock() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1000000000ULL + (u64)now.tv_nsec;
+}
+
+internal f32 get_seconds_elapsed(u64 start, u64 end) {
+    f32 result = (f32)(end - start) / 1000000000.0f;
+    return result;
+}
+
+internal void sleep_seconds(f32 seconds) {
+    timespec duration;
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - (f32)duration.tv_sec) * 1000000000.0f);
+    nanosleep(&duration, 0);
+}
+
+internal int compare_f32(const void* a, const void* b) {
+    f32 fa = *(f32*)a;
+    f32 fb = *(f32*)b;
+    return (fa > fb) - (fa < fb);
+}
+
+// scripted input so a benchmark run has a hero walking around and the camera moving
+internal void benchmark_input(GameInput* new_input, GameInput* old_input, u32 frame_index) {
+    GameControllerInput* old_keyboard_controller = get_controller(old_input, 0);
+    GameControllerInput* new_keyboard_controller = get_controller(new_input, 0);
+    *new_keyboard_controller = {};
+    new_keyboard_controller->is_connected = true;
+
+    bool start = frame_index == 1;
+    u32 leg = (frame_index / 90) % 4;
+    bool move_right = frame_index > 1 && leg == 0;
+    bool move_up = frame_index > 1 && leg == 1;
+    bool move_left = frame_index > 1 && leg == 2;
+    bool move_down = frame_index > 1 && leg == 3;
+
+    GameButtonState* old_buttons[] = {
+        &old_keyboard_controller->start, &old_keyboard_controller->move_right, &old_keyboard_controller->move_up,
+        &old_keyboard_controller->move_left, &old_keyboard_controller->move_down,
+    };
+    GameButtonState* new_buttons[] = {
+        &new_keyboard_controller->start, &new_keyboard_controller->move_right, &new_keyboard_controller->move_up,
+        &new_keyboard_controller->move_left, &new_keyboard_controller->move_down,
+    };
+    bool is_down[] = {start, move_right, move_up, move_left, move_down};
+    for (u32 i = 0; i < array_count(is_down); ++i) {
+        new_buttons[i]->ended_down = is_down[i];
+        new_buttons[i]->half_transition_count = (old_buttons[i]->ended_down != is_down[i]) ? 1 : 0;
+    }
+}
+
+internal void dump_buffer_ppm(GameOffscreenBuffer* buffer, char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (!file) return;
+
+    fprintf(file, "P6\n%d %d\n255\n", buffer->width, buffer->height);
+    u8* row = (u8*)buffer->memory;
+    for (int y = 0; y < buffer->height; ++y) {
+        u32* pixel = (u32*)row;
+        for (int x = 0; x < buffer->width; ++x) {
+            u8 rgb[3] = {(u8)(*pixel >> 16), (u8)(*pixel >> 8), (u8)(*pixel >> 0)};
+            fwrite(rgb, 1, sizeof(rgb), file);
+            ++pixel;
+        }
+        row += buffer->pitch;
+    }
+    fclose(file);
+}
+
+internal BenchmarkOptions parse_options(int argc, char** argv) {
+    BenchmarkOptions result = {};
+    result.frame_count = 300;
+    result.huge_pages = LHP_TRANSPARENT;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            result.frame_count = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--uncapped") == 0) {
+            result.uncapped = true;
+        } else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+            result.dump_filename = argv[++i];
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            result.worker_count = (u32)atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < argc) {
+            result.snapshot_filename = argv[++i];
+        } else if (strcmp(argv[i], "--memory") == 0) {
+            result.print_memory = true;
+        } else if (strcmp(argv[i], "--huge-pages") == 0 && i + 1 < argc && strcmp(argv[i + 1], "off") == 0) {
+            result.huge_pages = LHP_OFF;
+            ++i;
+        } else if (strcmp(argv[i], "--huge-pages") == 0 && i + 1 < argc && strcmp(argv[i + 1], "transparent") == 0) {
+            result.huge_pages = LHP_TRANSPARENT;
+            ++i;
+        } else if (strcmp(argv[i], "--huge-pages") == 0 && i + 1 < argc && strcmp(argv[i + 1], "explicit") == 0) {
+            result.huge_pages = LHP_EXPLICIT;
+            ++i;
+        } else {
+            fprintf(stderr, "usage: %s [--frames n] [--uncapped] [--dump last_frame.ppm] [--workers n]\n"
+                            "       [--snapshot world.hms] [--memory] [--huge-pages off|transparent|explicit]\n"
+                            "run from the data directory\n", argv[0]);
+            exit(1);
+        }
+    }
+    if (result.frame_count == 0) {
+        result.frame_count = 1;
+    }
+
+    return result;
+}
+
+int main(int argc, char** argv) {
+    BenchmarkOptions options = parse_options(argc, argv);
+
+    LinuxState linux_state = {};
+    get_exe_filename(&linux_state);
+    char source_game_code_so_full_path[LINUX_STATE_FILENAME_COUNT];
+    build_exe_path_filename(&linux_state, "handmade.so",
+                            sizeof(source_game_code_so_full_path), source_game_code_so_full_path);
+
+    GameCode game = load_game_code(source_game_code_so_full_path);
+    if (!game.is_valid) return 1;
+
+    // main thread helps out in complete_all_work, so one less worker than cores
+    long core_count = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 worker_thread_count = core_count > 1 ? (u32)core_count - 1 : 1;
+    if (options.worker_count) {
+        worker_thread_count = options.worker_count;
+    }
+    PlatformWorkQueue high_priority_queue = {};
+    linux_make_queue(&high_priority_queue, worker_thread_count, WQP_HIGH);
+    PlatformWorkQueue low_priority_queue = {};
+    linux_make_queue(&low_priority_queue, 2, WQP_LOW);
+
+    // 1920x1080 is 1080p, half that for software render
+    GameOffscreenBuffer buffer = {};
+    buffer.width = 960;
+    buffer.height = 540;
+    buffer.bytes_per_pixel = 4;
+    buffer.pitch = buffer.width * buffer.bytes_per_pixel;
+    buffer.memory = mmap(0, buffer.pitch * buffer.height, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    f32 game_update_hz = 30.0f;
+    f32 target_seconds_per_frame = 1.0f / game_update_hz;
+
+    int samples_per_second = 48000;
+    int samples_per_frame = (int)((f32)samples_per_second / game_update_hz);
+    s16* samples = (s16*)calloc(samples_per_frame, sizeof(s16) * 2);
+
+#if HANDMADE_INTERNAL
+    void* base_address = (void*)terabytes(2);
+#else
+    void* base_address = 0;
+#endif
+    GameMemory game_memory = {};
+    game_memory.permanent_storage_size = megabytes(256);
+    game_memory.transient_storage_size = gigabytes(1);
+    game_memory.debug_platform_read_entire_file = debug_platform_read_entire_file;
+    game_memory.debug_platform_write_entire_file = debug_platform_write_entire_file;
+    game_memory.debug_platform_free_file_memory = debug_platform_free_file_memory;
+    game_memory.high_priority_queue = &high_priority_queue;
+    game_memory.low_priority_queue = &low_priority_queue;
+    game_memory.platform_add_entry = linux_add_entry;
+    game_memory.platform_complete_all_work = linux_complete_all_work;
+    game_memory.platform_map_file = linux_map_file;
+    game_memory.platform_unmap_file = linux_unmap_file;
+    game_memory.platform_write_entire_file = linux_write_entire_file;
+    game_memory.platform_open_swap_file = linux_open_swap_file;
+    game_memory.platform_read_data_from_file = linux_read_data_from_file;
+    game_memory.platform_write_data_to_file = linux_write_data_to_file;
+    game_memory.snapshot_filename = options.snapshot_filename;
+
+    if (!linux_allocate_game_memory(&linux_state, base_address, game_memory.permanent_storage_size,
+                                    game_memory.transient_storage_size, options.huge_pages)) {
+        fprintf(stderr, "could not reserve game memory\n");
+        return 1;
+    }
+    game_memory.permanent_storage = linux_state.game_memory_block;
+    game_memory.transient_storage = (u8*)game_memory.permanent_storage + game_memory.permanent_storage_size;
+
+    GameInput inputs[2] = {};
+    GameInput* new_input = &inputs[0];
+    GameInput* old_input = &inputs[1];
+
+    f32* ms_per_frame = (f32*)calloc(options.frame_count, sizeof(f32));
+    u32 rss_sample_count = 0;
+    u64* rss_samples = (u64*)calloc(options.frame_count / LINUX_RSS_SAMPLE_FRAMES + 1, sizeof(u64));
+    u64 total_cycles = 0;
+
+    u64 run_start = get_wall_clock();
+    for (u32 frame_index = 0; frame_index < options.frame_count; ++frame_index) {
+        u64 frame_start = get_wall_clock();
+        u64 frame_start_cycles = __rdtsc();
+
+        new_input->dt_for_frame = target_seconds_per_frame;
+        benchmark_input(new_input, old_input, frame_index);
+        game_memory.snapshot_requested = frame_index == options.frame_count - 1;
+
+        ThreadContext thread = {};
+        game.update_and_render(&thread, &game_memory, new_input, &buffer);
+
+        GameOutputSoundBuffer sound_buffer = {};
+        sound_buffer.samples_per_second = samples_per_second;
+        sound_buffer.sample_count = samples_per_frame;
+        sound_buffer.samples = samples;
+        game.get_sound_samples(&thread, &game_memory, &sound_buffer);
+
+        // only the game's work counts, pacing sleep is not part of the measurement
+        if (frame_index > 0 || options.frame_count == 1) {
+            total_cycles += __rdtsc() - frame_start_cycles;
+        }
+        ms_per_frame[frame_index] = 1000.0f * get_seconds_elapsed(frame_start, get_wall_clock());
+
+        // reading /proc is not free, so it stays out of the frame time and only happens when asked
+        if (options.print_memory && (frame_index % LINUX_RSS_SAMPLE_FRAMES) == 0) {
+            rss_samples[rss_sample_count++] = linux_get_resident_size();
+        }
+
+        if (!options.uncapped) {
+            f32 seconds_elapsed_for_frame = get_seconds_elapsed(frame_start, get_wall_clock());
+            if (seconds_elapsed_for_frame < target_seconds_per_frame) {
+                sleep_seconds(target_seconds_per_frame - seconds_elapsed_for_frame);
+            } else {
+                // missed frame rate
+            }
+        }
+
+        GameInput* temp = new_input;
+        new_input = old_input;
+        old_input = temp;
+    }
+    f32 run_seconds = get_seconds_elapsed(run_start, get_wall_clock());
+
+    if (options.dump_filename) {
+        dump_buffer_ppm(&buffer, options.dump_filename);
+    }
+
+    // the first frame builds the world, report it separately so it doesn't skew the rest
+    f32 first_frame_ms = ms_per_frame[0];
+    u32 steady_count = options.frame_count > 1 ? options.frame_count - 1 : 1;
+    f32* steady = options.frame_count > 1 ? ms_per_frame + 1 : ms_per_frame;
+    f64 total_ms = 0;
+    for (u32 i = 0; i < steady_count; ++i) {
+        total_ms += steady[i];
+    }
+    qsort(steady, steady_count, sizeof(f32), compare_f32);
+    u32 p99_index = (u32)((f32)(steady_count - 1) * 0.99f);
+
+    f64 pixels_per_frame = (f64)buffer.width * (f64)buffer.height;
+    printf("frames:          %u (%s, %u workers)\n", options.frame_count,
+           options.uncapped ? "uncapped" : "paced 30hz", worker_thread_count);
+    printf("first frame:     %.3f ms\n", first_frame_ms);
+    printf("ms/frame min:    %.3f\n", steady[0]);
+    printf("ms/frame avg:    %.3f\n", total_ms / steady_count);
+    printf("ms/frame p99:    %.3f\n", steady[p99_index]);
+    printf("cycles/pixel:    %.2f\n", ((f64)total_cycles / steady_count) / pixels_per_frame);
+    printf("wall time:       %.3f s\n", run_seconds);
+    if (options.print_memory) {
+        print_memory_stats(&game, &game_memory);
+        print_resident_memory(&linux_state, options.huge_pages, rss_samples, rss_sample_count);
+    }
+
+    return 0;
+}
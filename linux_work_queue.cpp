@@ -0,0 +1,147 @@
+// Linux work queue - included by the linux platform layer
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/* NOTE:
+
+   The queue is a bounded multi-producer multi-consumer ring (Vyukov). Every
+   entry carries a sequence number that says whose turn it is:
+
+   sequence == position       the slot is free for the producer claiming position
+   sequence == position + 1   the slot holds work for the consumer claiming position
+
+   Producers and consumers each claim a position with a compare exchange on their
+   own counter, then hand the slot over by publishing the next sequence with a
+   release store. Nobody ever waits on a lock, sleeping workers are woken by the
+   semaphore that every add posts.
+*/
+struct PlatformWorkQueueEntry {
+    u32 volatile sequence;
+    platform_work_queue_callback* callback;
+    void* data;
+};
+
+enum WorkQueuePriority {
+    WQP_HIGH,
+    WQP_LOW,
+};
+
+struct PlatformWorkQueue {
+    u32 volatile completion_goal;
+    u32 volatile completion_count;
+
+    u32 volatile next_entry_to_write;
+    u32 volatile next_entry_to_read;
+    sem_t semaphore;
+
+    WorkQueuePriority priority;
+    PlatformWorkQueueEntry entries[256];
+};
+
+// returns true if it ran an entry, false if the queue was empty
+internal bool linux_do_next_work_queue_entry(PlatformWorkQueue* queue) {
+    u32 const mask = array_count(queue->entries) - 1;
+
+    PlatformWorkQueueEntry* entry;
+    u32 position;
+    for (;;) {
+        position = atomic_load_acquire_u32(&queue->next_entry_to_read);
+        entry = queue->entries + (position & mask);
+        s32 diff = (s32)(atomic_load_acquire_u32(&entry->sequence) - (position + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_u32(&queue->next_entry_to_read, position + 1, position) == position) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        }
+    }
+
+    platform_work_queue_callback* callback = entry->callback;
+    void* data = entry->data;
+    atomic_store_release_u32(&entry->sequence, position + mask + 1);
+
+    callback(queue, data);
+    atomic_add_u32(&queue->completion_count, 1);
+    return true;
+}
+
+PLATFORM_ADD_ENTRY(linux_add_entry) {
+    u32 const mask = array_count(queue->entries) - 1;
+
+    // count it before it becomes visible so complete_all_work can't miss it
+    atomic_add_u32(&queue->completion_goal, 1);
+
+    PlatformWorkQueueEntry* entry;
+    u32 position;
+    for (;;) {
+        position = atomic_load_acquire_u32(&queue->next_entry_to_write);
+        entry = queue->entries + (position & mask);
+        s32 diff = (s32)(atomic_load_acquire_u32(&entry->sequence) - position);
+        if (diff == 0) {
+            if (atomic_compare_exchange_u32(&queue->next_entry_to_write, position + 1, position) == position) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full, make room ourselves instead of waiting on the workers
+            linux_do_next_work_queue_entry(queue);
+        }
+    }
+
+    entry->callback = callback;
+    entry->data = data;
+    atomic_store_release_u32(&entry->sequence, position + 1);
+
+    sem_post(&queue->semaphore);
+}
+
+PLATFORM_COMPLETE_ALL_WORK(linux_complete_all_work) {
+    while (atomic_load_acquire_u32(&queue->completion_goal) != atomic_load_acquire_u32(&queue->completion_count)) {
+        if (!linux_do_next_work_queue_entry(queue)) {
+            // the last entries are running on workers
+            sched_yield();
+        }
+    }
+}
+
+internal void* linux_thread_proc(void* parameter) {
+    PlatformWorkQueue* queue = (PlatformWorkQueue*)parameter;
+
+    if (queue->priority == WQP_LOW) {
+        // nice is per thread on linux, lowering it needs no privileges
+        setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 10);
+    }
+
+    for (;;) {
+        if (!linux_do_next_work_queue_entry(queue)) {
+            sem_wait(&queue->semaphore);
+        }
+    }
+
+    return 0;
+}
+
+internal void linux_make_queue(PlatformWorkQueue* queue, u32 thread_count, WorkQueuePriority priority) {
+    queue->completion_goal = 0;
+    queue->completion_count = 0;
+    queue->next_entry_to_write = 0;
+    queue->next_entry_to_read = 0;
+    queue->priority = priority;
+    for (u32 i = 0; i < array_count(queue->entries); ++i) {
+        queue->entries[i].sequence = i;
+    }
+
+    sem_init(&queue->semaphore, 0, 0);
+
+    for (u32 thread_index = 0; thread_index < thread_count; ++thread_index) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        pthread_t thread;
+        pthread_create(&thread, &attr, linux_thread_proc, queue);
+        pthread_attr_destroy(&attr);
+    }
+}
@@ -55,8 +55,28 @@ struct Win32State {
     char* one_past_last_exe_filename_slash;
 };
 
+// same multi-producer multi-consumer ring as linux_work_queue.cpp, see the note there
+struct PlatformWorkQueueEntry {
+    u32 volatile sequence;
+    platform_work_queue_callback* callback;
+    void* data;
+};
+struct PlatformWorkQueue {
+    u32 volatile completion_goal;
+    u32 volatile completion_count;
+
+    u32 volatile next_entry_to_write;
+    u32 volatile next_entry_to_read;
+    HANDLE semaphore_handle;
+
+    int thread_priority;
+    PlatformWorkQueueEntry entries[256];
+};
+
 global bool g_running;
 global bool g_pause = false;
+global bool g_snapshot_requested;
+global bool g_dump_memory_stats;
 global OffscreenBuffer g_backbuffer;
 global LPDIRECTSOUNDBUFFER g_secondary_buffer;
 global s64 g_perf_count_frequency;
@@ -359,6 +379,121 @@ DEBUG_PLATFORM_WRITE_ENTIRE_FILE(debug_platform_write_entire_file) {
     return result;
 }
 
+PLATFORM_MAP_FILE(win32_map_file) {
+    PlatformMappedFile result = {};
+
+    HANDLE file_handle = CreateFile(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, NULL, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return result;
+    }
+
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file_handle, &file_size) && file_size.QuadPart > 0) {
+        HANDLE mapping = CreateFileMapping(file_handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            void* contents = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            if (contents) {
+                result.size = file_size.QuadPart;
+                result.contents = contents;
+            }
+            // the view keeps the mapping alive
+            CloseHandle(mapping);
+        }
+    }
+
+    CloseHandle(file_handle);
+    return result;
+}
+
+PLATFORM_UNMAP_FILE(win32_unmap_file) {
+    if (file->contents) {
+        UnmapViewOfFile(file->contents);
+    }
+    *file = {};
+}
+
+PLATFORM_WRITE_ENTIRE_FILE(win32_write_entire_file) {
+    char temp_filename[MAX_PATH];
+    sprintf_s(temp_filename, sizeof(temp_filename), "%s.tmp", filename);
+
+    HANDLE file_handle = CreateFile(temp_filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, 0, NULL);
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    bool result = true;
+    u8* bytes = (u8*)memory;
+    while (result && size) {
+        DWORD bytes_to_write = (DWORD)(size < megabytes(512) ? size : megabytes(512));
+        DWORD bytes_written;
+        if (!WriteFile(file_handle, bytes, bytes_to_write, &bytes_written, NULL) || bytes_written != bytes_to_write) {
+            result = false;
+        } else {
+            bytes += bytes_written;
+            size -= bytes_written;
+        }
+    }
+    CloseHandle(file_handle);
+
+    // the old snapshot is only replaced once the new one is all there
+    if (result) {
+        result = MoveFileEx(temp_filename, filename, MOVEFILE_REPLACE_EXISTING) != 0;
+    }
+    if (!result) {
+        DeleteFile(temp_filename);
+    }
+
+    return result;
+}
+
+PLATFORM_OPEN_SWAP_FILE(win32_open_swap_file) {
+    PlatformFileHandle result = {};
+
+    // deleted when the handle closes, which at the latest is when the process exits
+    HANDLE file_handle = CreateFile(filename, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                                    FILE_ATTRIBUTE_TEMPORARY | FILE_FLAG_DELETE_ON_CLOSE, NULL);
+    if (file_handle != INVALID_HANDLE_VALUE) {
+        result.no_errors = true;
+        result.platform = file_handle;
+    }
+
+    return result;
+}
+
+PLATFORM_READ_DATA_FROM_FILE(win32_read_data_from_file) {
+    if (!handle->no_errors) return false;
+
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (u32)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (u32)(offset >> 32);
+
+    u32 file_size_32 = safe_truncate_uint64(size);
+    DWORD bytes_read;
+    if (!ReadFile((HANDLE)handle->platform, dest, file_size_32, &bytes_read, &overlapped) || bytes_read != file_size_32) {
+        handle->no_errors = false;
+        return false;
+    }
+
+    return true;
+}
+
+PLATFORM_WRITE_DATA_TO_FILE(win32_write_data_to_file) {
+    if (!handle->no_errors) return false;
+
+    OVERLAPPED overlapped = {};
+    overlapped.Offset = (u32)(offset & 0xFFFFFFFF);
+    overlapped.OffsetHigh = (u32)(offset >> 32);
+
+    u32 file_size_32 = safe_truncate_uint64(size);
+    DWORD bytes_written;
+    if (!WriteFile((HANDLE)handle->platform, source, file_size_32, &bytes_written, &overlapped) || bytes_written != file_size_32) {
+        handle->no_errors = false;
+        return false;
+    }
+
+    return true;
+}
+
 void WriteFileChunked(HANDLE hFile, const void* buffer, size_t totalSize) {
 #define CHUNK_SIZE (500 * 1024 * 1024) // 500 mb
     const char* p = (const char*)buffer;
@@ -536,6 +671,10 @@ internal void process_pending_messages(Win32State* state, GameControllerInput* k
                     if (message.hwnd) {
                         toggle_fullscreen(message.hwnd);
                     }
+                } else if (vk_code == VK_F5 && is_down) {
+                    g_snapshot_requested = true;
+                } else if (vk_code == VK_F6 && is_down) {
+                    g_dump_memory_stats = true;
                 }
 #if HANDMADE_INTERNAL
                 else if (vk_code == 'P' && is_down) {
@@ -671,11 +810,110 @@ internal void debug_sync_display(int marker_count,
 }
 #endif
 
+// returns true if it ran an entry, false if the queue was empty
+internal bool win32_do_next_work_queue_entry(PlatformWorkQueue* queue) {
+    u32 const mask = array_count(queue->entries) - 1;
+
+    PlatformWorkQueueEntry* entry;
+    u32 position;
+    for (;;) {
+        position = atomic_load_acquire_u32(&queue->next_entry_to_read);
+        entry = queue->entries + (position & mask);
+        s32 diff = (s32)(atomic_load_acquire_u32(&entry->sequence) - (position + 1));
+        if (diff == 0) {
+            if (atomic_compare_exchange_u32(&queue->next_entry_to_read, position + 1, position) == position) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;
+        }
+    }
+
+    platform_work_queue_callback* callback = entry->callback;
+    void* data = entry->data;
+    atomic_store_release_u32(&entry->sequence, position + mask + 1);
+
+    callback(queue, data);
+    atomic_add_u32(&queue->completion_count, 1);
+    return true;
+}
+
+PLATFORM_ADD_ENTRY(win32_add_entry) {
+    u32 const mask = array_count(queue->entries) - 1;
+
+    // count it before it becomes visible so complete_all_work can't miss it
+    atomic_add_u32(&queue->completion_goal, 1);
+
+    PlatformWorkQueueEntry* entry;
+    u32 position;
+    for (;;) {
+        position = atomic_load_acquire_u32(&queue->next_entry_to_write);
+        entry = queue->entries + (position & mask);
+        s32 diff = (s32)(atomic_load_acquire_u32(&entry->sequence) - position);
+        if (diff == 0) {
+            if (atomic_compare_exchange_u32(&queue->next_entry_to_write, position + 1, position) == position) {
+                break;
+            }
+        } else if (diff < 0) {
+            // full, make room ourselves instead of waiting on the workers
+            win32_do_next_work_queue_entry(queue);
+        }
+    }
+
+    entry->callback = callback;
+    entry->data = data;
+    atomic_store_release_u32(&entry->sequence, position + 1);
+
+    ReleaseSemaphore(queue->semaphore_handle, 1, 0);
+}
+
+PLATFORM_COMPLETE_ALL_WORK(win32_complete_all_work) {
+    while (atomic_load_acquire_u32(&queue->completion_goal) != atomic_load_acquire_u32(&queue->completion_count)) {
+        if (!win32_do_next_work_queue_entry(queue)) {
+            // the last entries are running on workers
+            YieldProcessor();
+        }
+    }
+}
+
+DWORD WINAPI thread_proc(LPVOID lp_parameter) {
+    PlatformWorkQueue* queue = (PlatformWorkQueue*)lp_parameter;
+    SetThreadPriority(GetCurrentThread(), queue->thread_priority);
+
+    for (;;) {
+        if (!win32_do_next_work_queue_entry(queue)) {
+            WaitForSingleObjectEx(queue->semaphore_handle, INFINITE, FALSE);
+        }
+    }
+}
+
+internal void win32_make_queue(PlatformWorkQueue* queue, u32 thread_count, int thread_priority) {
+    queue->completion_goal = 0;
+    queue->completion_count = 0;
+    queue->next_entry_to_write = 0;
+    queue->next_entry_to_read = 0;
+    queue->thread_priority = thread_priority;
+    for (u32 i = 0; i < array_count(queue->entries); ++i) {
+        queue->entries[i].sequence = i;
+    }
+
+    u32 initial_count = 0;
+    queue->semaphore_handle = CreateSemaphoreEx(0, initial_count, thread_count, 0, 0, SEMAPHORE_ALL_ACCESS);
+
+    for (u32 thread_index = 0; thread_index < thread_count; ++thread_index) {
+        DWORD thread_id;
+        HANDLE thread_handle = CreateThread(0, 0, thread_proc, queue, 0, &thread_id);
+        CloseHandle(thread_handle);
+    }
+}
+
 struct GameCode {
     HMODULE game_code_dll;
     FILETIME last_write_time = {0};
     game_update_and_render_func* update_and_render;
     game_get_sound_samples_func* get_sound_samples;
+    // optional, only internal builds export it
+    debug_game_get_memory_stats_func* get_memory_stats;
     bool is_valid = false;
 };
 
@@ -696,6 +934,7 @@ internal void unload_game_code(GameCode* game_code) {
     game_code->last_write_time = {0};
     game_code->update_and_render = 0;
     game_code->get_sound_samples = 0;
+    game_code->get_memory_stats = 0;
 }
 
 internal void reload_game_code(GameCode* game, char* source_dll_name, char* temp_dll_name) {
@@ -722,16 +961,50 @@ internal void reload_game_code(GameCode* game, char* source_dll_name, char* temp
     if (game->game_code_dll) {
         game->update_and_render = (game_update_and_render_func*)GetProcAddress(game->game_code_dll, "game_update_and_render");
         game->get_sound_samples = (game_get_sound_samples_func*)GetProcAddress(game->game_code_dll, "game_get_sound_samples");
+        game->get_memory_stats = (debug_game_get_memory_stats_func*)GetProcAddress(game->game_code_dll, "debug_game_get_memory_stats");
         game->last_write_time = current_write_time;
         game->is_valid = game->update_and_render && game->get_sound_samples;
     }
     if (!game->is_valid) {
         game->update_and_render = 0;
         game->get_sound_samples = 0;
+        game->get_memory_stats = 0;
         game->last_write_time = {0};
     }
 }
 
+internal void win32_dump_memory_stats(GameCode* game, GameMemory* game_memory) {
+    if (!game->get_memory_stats) return;
+
+    DebugMemoryStats stats;
+    game->get_memory_stats(game_memory, &stats);
+
+    char text_buffer[256];
+    f64 mb = 1024.0 * 1024.0;
+    sprintf_s(text_buffer, sizeof(text_buffer), "permanent peak %.2f of %.2f MB, transient peak %.2f of %.2f MB\n",
+              stats.permanent_storage_peak / mb, game_memory->permanent_storage_size / mb,
+              stats.transient_storage_peak / mb, game_memory->transient_storage_size / mb);
+    OutputDebugStringA(text_buffer);
+    for (u32 i = 0; i < stats.arena_count; ++i) {
+        DebugArenaStats* arena = stats.arenas + i;
+        sprintf_s(text_buffer, sizeof(text_buffer), "arena %s used %.3f peak %.3f of %.3f MB, %llu pushes, last frame %u pushes %llu bytes\n",
+                  arena->name, arena->used / mb, arena->peak_used / mb, arena->size / mb,
+                  arena->push_count, arena->frame_push_count, arena->frame_pushed_size);
+        OutputDebugStringA(text_buffer);
+    }
+    for (u32 i = 0; i < stats.call_site_count; ++i) {
+        DebugArenaCallSite* site = stats.call_sites + i;
+        sprintf_s(text_buffer, sizeof(text_buffer), "  %s %s %llu pushes %.3f MB\n", site->arena_name, site->location,
+                  site->push_count, site->pushed_size / mb);
+        OutputDebugStringA(text_buffer);
+    }
+    f64 lookup_probes = stats.chunk_lookup_count ? (f64)stats.chunk_lookup_probe_count / (f64)stats.chunk_lookup_count : 0.0;
+    sprintf_s(text_buffer, sizeof(text_buffer), "chunk hash %u chunks in %u slots, load %.3f, probe length avg %.3f max %u, %llu lookups avg %.3f probes\n",
+              stats.chunk_count, stats.chunk_slot_count, stats.chunk_load_factor, stats.chunk_average_probe_length,
+              stats.chunk_max_probe_length, stats.chunk_lookup_count, lookup_probes);
+    OutputDebugStringA(text_buffer);
+}
+
 internal void get_exe_filename(Win32State* state) {
     DWORD size_of_filename = GetModuleFileName(0, state->exe_filename, sizeof(state->exe_filename));
     state->one_past_last_exe_filename_slash = state->exe_filename;
@@ -809,6 +1082,15 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
     clear_sound_buffer(&sound_output);
     g_secondary_buffer->Play(0, 0, DSBPLAY_LOOPING);
 
+    // main thread helps out in complete_all_work, so one less worker than cores
+    SYSTEM_INFO system_info;
+    GetSystemInfo(&system_info);
+    u32 worker_thread_count = system_info.dwNumberOfProcessors > 1 ? system_info.dwNumberOfProcessors - 1 : 1;
+    PlatformWorkQueue high_priority_queue = {};
+    win32_make_queue(&high_priority_queue, worker_thread_count, THREAD_PRIORITY_NORMAL);
+    PlatformWorkQueue low_priority_queue = {};
+    win32_make_queue(&low_priority_queue, 2, THREAD_PRIORITY_BELOW_NORMAL);
+
     g_running = true;
     s16* samples = (s16*)VirtualAlloc(0, sound_output.secondary_buffer_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
 
@@ -823,6 +1105,18 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
     game_memory.debug_platform_read_entire_file = debug_platform_read_entire_file;
     game_memory.debug_platform_write_entire_file = debug_platform_write_entire_file;
     game_memory.debug_platform_free_file_memory = debug_platform_free_file_memory;
+    game_memory.high_priority_queue = &high_priority_queue;
+    game_memory.low_priority_queue = &low_priority_queue;
+    game_memory.platform_add_entry = win32_add_entry;
+    game_memory.platform_complete_all_work = win32_complete_all_work;
+    game_memory.platform_map_file = win32_map_file;
+    game_memory.platform_unmap_file = win32_unmap_file;
+    game_memory.platform_write_entire_file = win32_write_entire_file;
+    game_memory.platform_open_swap_file = win32_open_swap_file;
+    game_memory.platform_read_data_from_file = win32_read_data_from_file;
+    game_memory.platform_write_data_to_file = win32_write_data_to_file;
+    // next to test.hha in the data directory, F5 writes it
+    game_memory.snapshot_filename = "world.hms";
 
     win32_state.total_size = game_memory.permanent_storage_size + game_memory.transient_storage_size;
     win32_state.game_memory_block = VirtualAlloc(base_address, win32_state.total_size, MEM_RESERVE|MEM_COMMIT, PAGE_READWRITE);
@@ -953,9 +1247,17 @@ int WINAPI WinMain(HINSTANCE instance, HINSTANCE prev_instance, LPSTR cmd_line,
         if (win32_state.input_playing_index) {
             playback_input(&win32_state, new_input);
         }
+        if (g_snapshot_requested) {
+            game_memory.snapshot_requested = true;
+            g_snapshot_requested = false;
+        }
         if (game.update_and_render) {
             game.update_and_render(&thread, &game_memory, new_input, &go_buffer);
         }
+        if (g_dump_memory_stats) {
+            win32_dump_memory_stats(&game, &game_memory);
+            g_dump_memory_stats = false;
+        }
 
         LARGE_INTEGER audio_wall_clock = get_wall_clock();
         f32 from_begin_to_audio_seconds = get_seconds_elapsed(flip_wall_clock, audio_wall_clock);